@@ -18,7 +18,7 @@
 
 #include "global.h"
 
-#define PLAYBACK_INTERFACE "Nulloy/NPlaybackEngineInterface/0.9"
+#define PLAYBACK_INTERFACE "Nulloy/NPlaybackEngineInterface/0.10"
 
 class NPlaybackEngineInterface : public QObject
 {
@@ -50,6 +50,13 @@ public slots:
     Q_INVOKABLE virtual void jump(qint64 msec) { Q_UNUSED(msec); }
     Q_INVOKABLE virtual void setSpeed(qreal speed) { Q_UNUSED(speed); }
     Q_INVOKABLE virtual void setPitch(qreal pitch) { Q_UNUSED(pitch); }
+    // overlap of consecutive media, 0 for gapless playback:
+    Q_INVOKABLE virtual void setCrossfadeMsec(qint64 msec) { Q_UNUSED(msec); }
+    // file suffixes seeked to the exact sample rather than to the nearest key unit:
+    Q_INVOKABLE virtual void setAccurateSeekFormats(const QStringList &formats)
+    {
+        Q_UNUSED(formats);
+    }
 
     Q_INVOKABLE virtual void play() = 0;
     Q_INVOKABLE virtual void stop() = 0;
@@ -17,10 +17,19 @@
 #define N_TAG_READER_INTERFACE_H
 
 #include "global.h"
+#include <QList>
 #include <QMap>
 #include <QObject>
+#include <QStringList>
 
-#define TAGREADER_INTERFACE "Nulloy/NTagReaderInterface/0.9.5"
+#define TAGREADER_INTERFACE "Nulloy/NTagReaderInterface/0.9.6"
+
+// Tags of a file, as read by readMany().
+struct NTagData
+{
+    QString file;
+    QMap<QChar, QString> tags; // by tag character, as getTag() returns them
+};
 
 class NTagReaderInterface : public QObject
 {
@@ -39,6 +48,29 @@ public:
     virtual bool isWriteSupported() const { return false; }
     virtual QMap<QString, QStringList> getTags() const { return QMap<QString, QStringList>(); }
     virtual QMap<QString, QStringList> setTags(const QMap<QString, QStringList> &) {}
+
+    // the given tag characters of every file, in the order of the files, non-UTF-8 strings
+    // decoded with the given encoding. Doesn't change the current source and encoding of
+    // readers that read them in parallel, one at a time otherwise:
+    virtual QList<NTagData> readMany(const QStringList &files, const QString &tags,
+                                     const QString &encoding)
+    {
+        QList<NTagData> results;
+        setEncoding(encoding);
+        foreach (QString file, files) {
+            setSource(file);
+            NTagData data;
+            data.file = file;
+            foreach (QChar ch, tags) {
+                data.tags[ch] = getTag(ch);
+            }
+            results << data;
+        }
+        return results;
+    }
+
+    // whether readMany() may be called from another thread than the rest of the reader:
+    virtual bool isReadManyThreadSafe() const { return false; }
 };
 
 Q_DECLARE_INTERFACE(NTagReaderInterface, TAGREADER_INTERFACE)
@@ -20,7 +20,19 @@
 
 #include "waveformPeaks.h"
 
-#define WAVEFORM_INTERFACE "Nulloy/NWaveformBuilderInterface/0.7"
+#define WAVEFORM_INTERFACE "Nulloy/NWaveformBuilderInterface/0.8"
+
+struct NWaveformCacheStats
+{
+    qint64 memoryHits;
+    qint64 diskHits;
+    qint64 misses;
+    qint64 memoryEvictions;
+    qint64 diskEvictions;
+    qint64 memoryBytes;
+    qint64 diskBytes;
+    qint64 precomputed;
+};
 
 class NWaveformBuilderInterface : public QThread
 {
@@ -32,8 +44,18 @@ public:
     virtual void stop() = 0;
     virtual void positionAndIndex(float &pos, int &index) = 0;
     virtual const NWaveformPeaks &peaks() const = 0;
+    virtual void precompute(const QStringList &files) = 0; // in the background, into the cache
+    virtual void setPrecomputeJobs(int jobs) = 0;
+    virtual void precomputeWait() = 0; // until everything requested has been precomputed
+    virtual void setSharedDecode(bool enable) = 0; // build from the audio decoded for playback
+    virtual void setCacheBudget(qint64 memoryBytes, qint64 diskBytes) = 0;
+    virtual NWaveformCacheStats cacheStats() const = 0;
 
     static QString interfaceString() { return WAVEFORM_INTERFACE; }
+
+signals:
+    virtual void peaksAdvanced() = 0; // once until positionAndIndex() is called again
+    virtual void peaksCompleted() = 0;
 };
 
 Q_DECLARE_INTERFACE(NWaveformBuilderInterface, WAVEFORM_INTERFACE)
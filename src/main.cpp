@@ -17,7 +17,10 @@
 
 #include "common.h"
 #include "player.h"
+#include "pluginLoader.h"
 #include "settings.h"
+#include "utils.h"
+#include "waveformBuilderInterface.h"
 
 #ifndef _N_NO_SKINS_
 #include "skinFileSystem.h"
@@ -42,13 +45,15 @@ static void print_help()
               " [[option] | [files]]\n"
               "\n"
               "Options:\n"
-              "    --next         play next file\n"
-              "    --prev         play previous file\n"
-              "    --stop         stop playback\n"
-              "    --pause        pause playback\n"
-              "    --log          log to file\n"
-              "    --version      print version\n"
-              "    -h, --help     print this message\n");
+              "    --next                play next file\n"
+              "    --prev                play previous file\n"
+              "    --stop                stop playback\n"
+              "    --pause               pause playback\n"
+              "    --log                 log to file\n"
+              "    --build-peaks PATH    build waveforms of a directory or a playlist and exit\n"
+              "    --jobs N              number of files to decode at once with --build-peaks\n"
+              "    --version             print version\n"
+              "    -h, --help            print this message\n");
 }
 
 static void print_try()
@@ -56,6 +61,52 @@ static void print_try()
     print_out("Try `" + NCore::applicationBasenameName() + " --help' for more information");
 }
 
+static int build_peaks(const QString &path, int jobs)
+{
+    NPluginLoader::init();
+    NWaveformBuilderInterface *builder = dynamic_cast<NWaveformBuilderInterface *>(
+        NPluginLoader::getPlugin(N::WaveformBuilder));
+    if (!builder) {
+        NPluginLoader::deinit();
+        return 1;
+    }
+    builder->setCacheBudget(
+        NSettings::instance()->value("WaveformCacheMemoryMB").toLongLong() * 1024 * 1024,
+        NSettings::instance()->value("WaveformCacheDiskMB").toLongLong() * 1024 * 1024);
+    builder->setPrecomputeJobs(jobs);
+
+    QStringList files;
+    qint64 bytes = 0;
+    foreach (NPlaylistDataItem dataItem, NUtils::dirListRecursive(path)) {
+        QFileInfo fileInfo(dataItem.path);
+        if (fileInfo.isFile()) {
+            files << dataItem.path;
+            bytes += fileInfo.size();
+        }
+    }
+    print_out(QString("building peaks of %1 files with %2 jobs").arg(files.size()).arg(jobs));
+
+    QElapsedTimer timer;
+    timer.start();
+    builder->precompute(files);
+    builder->precomputeWait();
+    qreal seconds = qMax((qint64)1, timer.elapsed()) / 1000.0;
+
+    NWaveformCacheStats stats = builder->cacheStats();
+    print_out(QString("%1 files, %2 MB in %3 s: %4 files/s, %5 MB/s (%6 built, %7 already cached "
+                      "or failed)")
+                  .arg(files.size())
+                  .arg(bytes / 1024.0 / 1024.0, 0, 'f', 1)
+                  .arg(seconds, 0, 'f', 1)
+                  .arg(files.size() / seconds, 0, 'f', 1)
+                  .arg(bytes / 1024.0 / 1024.0 / seconds, 0, 'f', 1)
+                  .arg(stats.precomputed)
+                  .arg(files.size() - stats.precomputed));
+
+    NPluginLoader::deinit();
+    return 0;
+}
+
 void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
 {
     Q_UNUSED(context);
@@ -125,7 +176,10 @@ int main(int argc, char *argv[])
     argList.takeFirst();
     QStringList files;
     QStringList options;
-    foreach (QString arg, argList) {
+    QString buildPeaksPath;
+    int jobs = QThread::idealThreadCount();
+    for (int i = 0; i < argList.size(); ++i) {
+        QString arg = argList.at(i);
         if (arg.startsWith("-")) {
             if (arg == "-h") {
                 print_help();
@@ -135,6 +189,24 @@ int main(int argc, char *argv[])
                     options << arg;
                 } else if (arg == "--log") {
                     logToFile = true;
+                } else if (arg == "--build-peaks" || arg == "--jobs") {
+                    if (i + 1 == argList.size()) {
+                        print_err("option '" + arg + "' requires an argument");
+                        print_try();
+                        return 1;
+                    }
+                    QString value = argList.at(++i);
+                    if (arg == "--build-peaks") {
+                        buildPeaksPath = value;
+                    } else {
+                        bool ok;
+                        jobs = value.toInt(&ok);
+                        if (!ok || jobs < 1) {
+                            print_err("invalid number of jobs '" + value + "'");
+                            print_try();
+                            return 1;
+                        }
+                    }
                 } else if (arg == "--version") {
                     print_out(instance.applicationVersion());
                     return 0;
@@ -156,6 +228,10 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (!buildPeaksPath.isEmpty()) {
+        return build_peaks(buildPeaksPath, jobs);
+    }
+
     // construct message
     QString msg = (options + files).join(MSG_SPLITTER);
     if (NSettings::instance()->value("SingleInstance").toBool()) {
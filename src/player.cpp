@@ -31,6 +31,7 @@
 #include "preferencesDialog.h"
 #include "scriptEngine.h"
 #include "settings.h"
+#include "tagCache.h"
 #include "tagEditorDialog.h"
 #include "trackInfoReader.h"
 #include "trackInfoWidget.h"
@@ -52,6 +53,7 @@
 #include "macDock.h"
 #endif
 
+#include <QDebug>
 #include <QFileDialog>
 #include <QFileInfo>
 #include <QMenu>
@@ -67,8 +69,15 @@
 #include <QNetworkRequest>
 #endif
 
+#define STARTUP_TIME_ENV "NULLOY_STARTUP_TIME"
+
 NPlayer::NPlayer()
 {
+    // up to the first paint of the main window, see eventFilter():
+    if (qEnvironmentVariableIsSet(STARTUP_TIME_ENV)) {
+        m_startupTimer.start();
+    }
+
     qsrand((uint)QTime::currentTime().msec());
     m_settings = NSettings::instance();
 
@@ -83,6 +92,8 @@ NPlayer::NPlayer()
     m_trackInfoReader = new NTrackInfoReader(dynamic_cast<NTagReaderInterface *>(
                                                  NPluginLoader::getPlugin(N::TagReader)),
                                              this);
+    m_tagCache = new NTagCache(NCore::rcDir() + "/" + NCore::applicationBinaryName() + ".tags");
+    m_trackInfoReader->setCache(m_tagCache);
 
     m_coverReader = dynamic_cast<NCoverReaderInterface *>(NPluginLoader::getPlugin(N::CoverReader));
 
@@ -182,9 +193,11 @@ NPlayer::NPlayer()
 
 NPlayer::~NPlayer()
 {
+    m_playlistWidget->setTrackInfoReader(NULL); // stops reading tags before the plugins go
     NPluginLoader::deinit();
     delete m_mainWindow;
     delete m_settings;
+    delete m_tagCache;
 }
 
 void NPlayer::createActions()
@@ -359,7 +372,6 @@ void NPlayer::createActions()
     // << speed actions
 
     // pitch actions >>
-    /*
     m_pitchIncreaseAction = new NAction(tr("Pitch Increase"), this);
     m_pitchIncreaseAction->setObjectName("PitchIncreaseAction");
     m_pitchIncreaseAction->setStatusTip(tr("Increase playback pitch"));
@@ -374,7 +386,6 @@ void NPlayer::createActions()
     m_pitchResetAction->setObjectName("PitchResetAction");
     m_pitchResetAction->setStatusTip(tr("Reset pitch to 1.0"));
     m_pitchResetAction->setCustomizable(true);
-    */
     // << pitch actions
 
     // keyboard shortcuts
@@ -653,13 +664,11 @@ void NPlayer::connectSignals()
             SLOT(on_speedDecreaseAction_triggered()));
     connect(m_speedResetAction, SIGNAL(triggered()), this, SLOT(on_speedResetAction_triggered()));
 
-    /*
     connect(m_pitchIncreaseAction, SIGNAL(triggered()), this,
             SLOT(on_pitchIncreaseAction_triggered()));
     connect(m_pitchDecreaseAction, SIGNAL(triggered()), this,
             SLOT(on_pitchDecreaseAction_triggered()));
     connect(m_pitchResetAction, SIGNAL(triggered()), this, SLOT(on_pitchResetAction_triggered()));
-    */
 
     connect(m_mainWindow, SIGNAL(customContextMenuRequested(const QPoint &)), this,
             SLOT(showContextMenu(const QPoint &)));
@@ -675,6 +684,11 @@ NPlaybackEngineInterface *NPlayer::playbackEngine()
 
 bool NPlayer::eventFilter(QObject *obj, QEvent *event)
 {
+    if (event->type() == QEvent::Paint && obj == m_mainWindow && m_startupTimer.isValid()) {
+        qDebug() << "NPlayer :: first paint after" << m_startupTimer.elapsed() << "msec";
+        m_startupTimer.invalidate();
+    }
+
     if (event->type() == QEvent::FileOpen) {
         QFileOpenEvent *fileEvent = static_cast<QFileOpenEvent *>(event);
 
@@ -827,6 +841,9 @@ void NPlayer::loadSettings()
 
     m_playbackEngine->setVolume(m_settings->value("Volume").toFloat());
     m_volumeSlider->setValue(m_settings->value("Volume").toFloat());
+    m_playbackEngine->setCrossfadeMsec(qRound(m_settings->value("Crossfade").toDouble() * 1000));
+    m_playbackEngine->setAccurateSeekFormats(
+        m_settings->value("AccurateSeekFormats").toStringList());
 }
 
 void NPlayer::saveSettings()
@@ -847,9 +864,14 @@ void NPlayer::savePlaybackState()
 void NPlayer::on_preferencesDialog_settingsChanged()
 {
     m_systemTray->setVisible(m_settings->value("TrayIcon").toBool());
+    m_trackInfoReader->loadSettings();
     m_trackInfoWidget->loadSettings();
     m_trackInfoWidget->updateFileLabels(m_playbackEngine->currentMedia());
+    m_waveformSlider->loadSettings();
     m_playlistWidget->processVisibleItems();
+    m_playbackEngine->setCrossfadeMsec(qRound(m_settings->value("Crossfade").toDouble() * 1000));
+    m_playbackEngine->setAccurateSeekFormats(
+        m_settings->value("AccurateSeekFormats").toStringList());
 }
 
 #ifndef _N_NO_UPDATE_CHECK_
@@ -16,6 +16,7 @@
 #ifndef N_PLAYER_H
 #define N_PLAYER_H
 
+#include <QElapsedTimer>
 #include <QSystemTrayIcon>
 #include <QWidget>
 
@@ -38,6 +39,7 @@ class NTrackInfoWidget;
 class QMenu;
 class NAction;
 class QString;
+class NTagCache;
 class QTimer;
 
 #ifndef _N_NO_UPDATE_CHECK_
@@ -53,6 +55,7 @@ private:
     NSettings *m_settings;
     NScriptEngine *m_scriptEngine;
     NMainWindow *m_mainWindow;
+    QElapsedTimer m_startupTimer; // valid until the first paint, if measured
     NCoverWidget *m_coverWidget;
     NCoverReaderInterface *m_coverReader;
     NWaveformSlider *m_waveformSlider;
@@ -60,6 +63,7 @@ private:
     NAboutDialog *m_aboutDialog;
     NVolumeSlider *m_volumeSlider;
     NTrackInfoReader *m_trackInfoReader;
+    NTagCache *m_tagCache;
     NPlaybackEngineInterface *m_playbackEngine;
     QMenu *m_contextMenu;
     QMenu *m_windowSubMenu;
@@ -18,98 +18,268 @@
 #include <QCryptographicHash>
 #include <QObject>
 #include <QtCore>
+#include <climits>
 
 #include "common.h"
 
+#define CACHE_MEMORY_BYTES (32 * 1024 * 1024)
+#define CACHE_DISK_BYTES (512 * 1024 * 1024)
+#define FINGERPRINT_BLOCK (64 * 1024)
+#define PUBLISH_BATCH 256
+
+class NWaveformPrecomputeWorker : public QRunnable
+{
+private:
+    NAbstractWaveformBuilder *m_builder;
+
+public:
+    NWaveformPrecomputeWorker(NAbstractWaveformBuilder *builder) : m_builder(builder) {}
+    void run() { m_builder->precomputeRun(); }
+};
+
 NAbstractWaveformBuilder::NAbstractWaveformBuilder()
 {
-    m_cacheLoaded = false;
+    m_published = 0;
+    m_memoryHits = 0;
+    m_diskHits = 0;
+    m_misses = 0;
+    m_memoryEvictions = 0;
+    m_precomputed = 0;
+    m_precomputeWorkers = 0;
+    m_precomputeCancelled = false;
+    // leave a core for playback:
+    m_precomputePool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
     m_cacheFile = NCore::rcDir() + "/" + NCore::applicationBinaryName() + ".peaks";
+    m_cache = new NWaveformCache(m_cacheFile);
+    setCacheBudget(CACHE_MEMORY_BYTES, CACHE_DISK_BYTES);
 }
 
-NAbstractWaveformBuilder::~NAbstractWaveformBuilder() {}
+NAbstractWaveformBuilder::~NAbstractWaveformBuilder()
+{
+    precomputeStop();
+#if defined(QT_DEBUG) && !defined(QT_NO_DEBUG)
+    NWaveformCacheStats stats = cacheStats();
+    qDebug() << "WaveformBuilder ::"
+             << "cache hits" << stats.memoryHits << "+" << stats.diskHits << "misses"
+             << stats.misses << "evictions" << stats.memoryEvictions << "+" << stats.diskEvictions;
+#endif
+    delete m_cache;
+}
 
-void NAbstractWaveformBuilder::cacheLoad()
+void NAbstractWaveformBuilder::setCacheBudget(qint64 memoryBytes, qint64 diskBytes)
 {
-    QFile cache(m_cacheFile);
+    // costs are in kilobytes to stay within int:
+    int count = m_peaksCache.count();
+    m_peaksCache.setMaxCost((int)qBound((qint64)1, memoryBytes / 1024, (qint64)INT_MAX));
+    m_memoryEvictions += count - m_peaksCache.count();
+    m_cache->setMaxSize(diskBytes);
+}
 
-    if (m_cacheLoaded || !cache.exists()) {
-        return;
+NWaveformCacheStats NAbstractWaveformBuilder::cacheStats() const
+{
+    NWaveformCacheStats stats;
+    stats.memoryHits = m_memoryHits;
+    stats.diskHits = m_diskHits;
+    stats.misses = m_misses;
+    stats.memoryEvictions = m_memoryEvictions;
+    stats.diskEvictions = m_cache->evictions();
+    stats.memoryBytes = (qint64)m_peaksCache.totalCost() * 1024;
+    stats.diskBytes = m_cache->size();
+    QMutexLocker locker(&m_precomputeMutex);
+    stats.precomputed = m_precomputed;
+    return stats;
+}
+
+void NAbstractWaveformBuilder::peaksCacheInsert(const QByteArray &key, const NWaveformPeaks &peaks)
+{
+    // QCache drops the least recently used entries to make room:
+    int count = m_peaksCache.count() + (m_peaksCache.contains(key) ? 0 : 1);
+    m_peaksCache.insert(key, new NWaveformPeaks(peaks), peaks.bytes() / 1024 + 1);
+    m_memoryEvictions += count - m_peaksCache.count();
+}
+
+QByteArray NAbstractWaveformBuilder::pathKey(const QString &file) const
+{
+    QDir dir(QFileInfo(m_cacheFile).absolutePath());
+    QString path = dir.relativeFilePath(QFileInfo(file).absoluteFilePath());
+    return QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1);
+}
+
+QByteArray NAbstractWaveformBuilder::contentKey(const QString &file) const
+{
+    QFile input(file);
+    if (!input.open(QIODevice::ReadOnly)) {
+        return QByteArray();
     }
 
-    QByteArray compressed;
-    cache.open(QIODevice::ReadOnly);
-    QDataStream inFile(&cache);
-    inFile >> compressed;
-    cache.close();
+    // size, head and tail blocks:
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    QByteArray size;
+    QDataStream outSize(&size, QIODevice::WriteOnly);
+    outSize << (qint64)input.size();
+    hash.addData(size);
+    hash.addData(input.read(FINGERPRINT_BLOCK));
+    if (input.size() > FINGERPRINT_BLOCK) {
+        input.seek(qMax((qint64)FINGERPRINT_BLOCK, input.size() - FINGERPRINT_BLOCK));
+        hash.addData(input.read(FINGERPRINT_BLOCK));
+    }
+    return hash.result();
+}
 
-    QByteArray buffer = qUncompress(compressed);
-    QDataStream inBuffer(&buffer, QIODevice::ReadOnly);
+QByteArray NAbstractWaveformBuilder::cacheKey(const QString &file) const
+{
+    QByteArray pathHash = pathKey(file);
+    QString modifDate = cacheDate(file);
+    qint64 size = QFileInfo(file).size();
 
-    QList<QByteArray> hashes;
-    QList<NWaveformPeaks> peaks;
-    inBuffer >> hashes >> peaks >> m_dateHash;
+    // the file is only read when its path is new or it has changed:
+    QByteArray key = m_cache->fingerprint(pathHash, modifDate, size);
+    if (!key.isEmpty()) {
+        return key;
+    }
+    key = contentKey(file);
+    if (key.isEmpty()) {
+        return key;
+    }
 
-    Q_ASSERT(hashes.count() == peaks.count());
-    m_peaksCache.clear();
-    for (int i = 0; i < hashes.count(); ++i) {
-        m_peaksCache.insert(hashes.at(i), new NWaveformPeaks(peaks.at(i)));
+    // peaks stored under the path by older versions, moved before the path is mapped, since
+    // a mapped path marks them as migrated:
+    if (m_cache->contains(pathHash)) {
+        NWaveformPeaks peaks;
+        if (!m_cache->contains(key) && m_cache->date(pathHash) == modifDate &&
+            m_cache->read(pathHash, peaks)) {
+            m_cache->insert(key, modifDate, peaks);
+        }
+        m_cache->remove(pathHash);
     }
+    m_cache->insertPath(pathHash, modifDate, size, key);
 
-    m_cacheLoaded = true;
+    return key;
 }
 
-void NAbstractWaveformBuilder::cacheSave()
+QString NAbstractWaveformBuilder::cacheDate(const QString &file) const
 {
-    QByteArray buffer;
-    QDataStream outBuffer(&buffer, QIODevice::WriteOnly);
+    return QFileInfo(file).lastModified().toString(Qt::ISODate);
+}
 
-    QList<QByteArray> hashes = m_peaksCache.keys();
-    QList<NWaveformPeaks> peaks;
-    foreach (QByteArray hash, hashes) {
-        peaks << *m_peaksCache.object(hash);
+void NAbstractWaveformBuilder::precompute(const QStringList &files)
+{
+    QMutexLocker locker(&m_precomputeMutex);
+    if (m_precomputeCancelled) {
+        return;
     }
 
-    outBuffer << hashes << peaks << m_dateHash;
-    QByteArray compressed = qCompress(buffer);
+    // the latest request replaces whatever is still pending:
+    m_precomputeQueue.clear();
+    QSet<QString> queued;
+    foreach (const QString &file, files) {
+        if (queued.contains(file) || !QFileInfo(file).exists()) {
+            continue;
+        }
+        queued << file;
+        m_precomputeQueue << file;
+    }
 
-    QFile cache(m_cacheFile);
-    QDataStream outFile(&cache);
-    cache.open(QIODevice::WriteOnly);
-    outFile << compressed;
-    cache.close();
+    while (m_precomputeWorkers < m_precomputePool.maxThreadCount() &&
+           m_precomputeWorkers < m_precomputeQueue.size()) {
+        ++m_precomputeWorkers;
+        m_precomputePool.start(new NWaveformPrecomputeWorker(this));
+    }
 }
 
-bool NAbstractWaveformBuilder::peaksFindFromCache(const QString &file)
+void NAbstractWaveformBuilder::precomputeRun()
 {
-    cacheLoad();
-    if (!m_cacheLoaded) {
-        return false;
+    QThread::currentThread()->setPriority(QThread::LowPriority);
+
+    forever {
+        QString file;
+        {
+            QMutexLocker locker(&m_precomputeMutex);
+            if (m_precomputeQueue.isEmpty() || m_precomputeCancelled) {
+                --m_precomputeWorkers;
+                return;
+            }
+            file = m_precomputeQueue.takeFirst();
+        }
+
+        QByteArray key = cacheKey(file);
+        if (key.isEmpty() || m_cache->contains(key)) {
+            continue;
+        }
+
+        NWaveformPeaks peaks;
+        if (decode(file, peaks) && peaks.isCompleted()) {
+            m_cache->insert(key, cacheDate(file), peaks);
+            {
+                QMutexLocker locker(&m_precomputeMutex);
+                ++m_precomputed;
+            }
+#if defined(QT_DEBUG) && !defined(QT_NO_DEBUG)
+            qDebug() << "WaveformBuilder ::"
+                     << "precomputed" << file;
+#endif
+        }
     }
+}
 
-    QDir dir(QFileInfo(m_cacheFile).absolutePath());
-    QString path = dir.relativeFilePath(QFileInfo(file).absoluteFilePath());
+void NAbstractWaveformBuilder::setPrecomputeJobs(int jobs)
+{
+    QMutexLocker locker(&m_precomputeMutex);
+    m_precomputePool.setMaxThreadCount(qMax(1, jobs));
+}
 
-    QByteArray pathHash = QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1);
-    QString modifDate = m_dateHash.value(pathHash);
-    if (modifDate.isEmpty()) {
-        return false;
+void NAbstractWaveformBuilder::precomputeWait()
+{
+    // workers quit once the queue is empty:
+    m_precomputePool.waitForDone();
+}
+
+bool NAbstractWaveformBuilder::precomputeCancelled()
+{
+    QMutexLocker locker(&m_precomputeMutex);
+    return m_precomputeCancelled;
+}
+
+void NAbstractWaveformBuilder::precomputeStop()
+{
+    {
+        QMutexLocker locker(&m_precomputeMutex);
+        m_precomputeCancelled = true;
+        m_precomputeQueue.clear();
     }
+    m_precomputePool.waitForDone();
+}
 
-    if (modifDate == QFileInfo(file).lastModified().toString(Qt::ISODate)) {
-        NWaveformPeaks *peaks = m_peaksCache.object(pathHash);
-        if (peaks) {
-            m_peaks = NWaveformPeaks(*peaks);
-            return true;
-        } else {
-            m_dateHash.remove(pathHash);
-            return false;
-        }
+bool NAbstractWaveformBuilder::peaksFindFromCache(const QString &file)
+{
+    {
+        // the foreground build takes over:
+        QMutexLocker locker(&m_precomputeMutex);
+        m_precomputeQueue.removeAll(file);
+    }
+
+    QByteArray key = cacheKey(file);
+
+    NWaveformPeaks peaks;
+    if (key.isEmpty()) {
+        ++m_misses;
+        return false;
+    } else if (NWaveformPeaks *cached = m_peaksCache.object(key)) {
+        peaks = *cached;
+        ++m_memoryHits;
+    } else if (m_cache->read(key, peaks)) {
+        peaksCacheInsert(key, peaks);
+        ++m_diskHits;
     } else {
-        m_peaksCache.remove(pathHash);
-        m_dateHash.remove(pathHash);
+        ++m_misses;
         return false;
     }
+
+    m_peaks = peaks;
+    m_peaksView = peaks;
+    m_published = 0;
+    m_ring.reset();
+    return true;
 }
 
 void NAbstractWaveformBuilder::peaksAppendToCache(const QString &file)
@@ -118,34 +288,77 @@ void NAbstractWaveformBuilder::peaksAppendToCache(const QString &file)
         return;
     }
 
-    QDir dir(QFileInfo(m_cacheFile).absolutePath());
-    QString path = dir.relativeFilePath(QFileInfo(file).absoluteFilePath());
-
-    QByteArray pathHash = QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1);
-    m_peaksCache.insert(pathHash, new NWaveformPeaks(m_peaks));
-    m_dateHash.insert(pathHash, QFileInfo(file).lastModified().toString(Qt::ISODate));
-
-    cacheSave();
+    QByteArray key = cacheKey(file);
+    if (key.isEmpty()) {
+        return;
+    }
+    peaksCacheInsert(key, m_peaks);
+    m_cache->insert(key, cacheDate(file), m_peaks);
 }
 
 void NAbstractWaveformBuilder::reset()
 {
     m_peaks.reset();
+    m_peaksView.reset();
+    m_published = 0;
+    m_ring.reset();
+    m_advancedPending.storeRelease(0);
     m_oldIndex = 0;
     m_oldPos = 0.0;
 }
 
+bool NAbstractWaveformBuilder::peaksPublish()
+{
+    // bins that don't fit stay in m_peaks until the next call:
+    NWaveformPeaks::Bin batch[PUBLISH_BATCH];
+    int published = m_published;
+    int size = m_peaks.size(0);
+    while (m_published < size) {
+        int count = qMin(size - m_published, PUBLISH_BATCH);
+        for (int i = 0; i < count; ++i) {
+            batch[i] = m_peaks.bin(0, m_published + i);
+        }
+        int pushed = m_ring.push(batch, count);
+        m_published += pushed;
+        if (pushed < count) {
+            break;
+        }
+    }
+
+    // a single notification until the GUI thread comes to take the bins:
+    return m_published > published && m_advancedPending.testAndSetOrdered(0, 1);
+}
+
+void NAbstractWaveformBuilder::peaksComplete()
+{
+    if (!m_peaks.isCompleted()) {
+        m_peaks.complete();
+    }
+    m_peaksView = m_peaks;
+    m_published = 0;
+    m_ring.reset();
+}
+
 void NAbstractWaveformBuilder::positionAndIndex(float &pos, int &index)
 {
-    if (m_peaks.isCompleted()) {
+    if (!m_peaksView.isCompleted()) {
+        m_advancedPending.fetchAndStoreOrdered(0);
+        NWaveformPeaks::Bin batch[PUBLISH_BATCH];
+        int count;
+        while ((count = m_ring.pop(batch, PUBLISH_BATCH)) > 0) {
+            m_peaksView.appendBins(batch, count);
+        }
+    }
+
+    if (m_peaksView.isCompleted()) {
         pos = 1.0;
-        index = m_peaks.size();
+        index = m_peaksView.size();
         return;
     }
 
     float newPos = position();
     if (newPos != m_oldPos) {
-        m_oldIndex = m_peaks.size();
+        m_oldIndex = m_peaksView.size();
         m_oldPos = newPos;
     }
 
@@ -17,8 +17,12 @@
 #define N_ABSTRACT_WAVEFORM_BUILDER_H
 
 #include <QCache>
-#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadPool>
 
+#include "waveformBuilderInterface.h"
+#include "waveformCache.h"
 #include "waveformPeaks.h"
 
 class QString;
@@ -28,28 +32,61 @@ class NAbstractWaveformBuilder
 private:
     int m_oldIndex;
     float m_oldPos;
-    bool m_cacheLoaded;
     QString m_cacheFile;
+    NWaveformCache *m_cache;
+    NWaveformPeaks m_peaksView; // the GUI thread's copy
+    NWaveformPeaksRing m_ring;
+    int m_published; // level 0 bins of m_peaks pushed to m_ring
+    QAtomicInt m_advancedPending;
+    qint64 m_memoryHits;
+    qint64 m_diskHits;
+    qint64 m_misses;
+    qint64 m_memoryEvictions;
+    qint64 m_precomputed;
 
-    void cacheLoad();
-    void cacheSave();
+    QThreadPool m_precomputePool;
+    mutable QMutex m_precomputeMutex;
+    QStringList m_precomputeQueue;
+    int m_precomputeWorkers;
+    bool m_precomputeCancelled;
+
+    QByteArray pathKey(const QString &file) const;
+    QByteArray contentKey(const QString &file) const;
+    QByteArray cacheKey(const QString &file) const;
+    QString cacheDate(const QString &file) const;
+
+    friend class NWaveformPrecomputeWorker;
+    void precomputeRun();
+    void peaksCacheInsert(const QByteArray &key, const NWaveformPeaks &peaks);
 
 protected:
-    NWaveformPeaks m_peaks;
+    NWaveformPeaks m_peaks; // owned by the decoding thread until peaksComplete()
+    mutable QMutex m_mutex;
     QCache<QByteArray, NWaveformPeaks> m_peaksCache;
-    QHash<QByteArray, QString> m_dateHash;
 
     virtual void reset();
+    bool peaksPublish();  // from the decoding thread, never blocks, true to emit peaksAdvanced()
+    void peaksComplete(); // from the GUI thread, once the decoding has stopped
     virtual qreal position() const = 0;
     bool peaksFindFromCache(const QString &file);
     void peaksAppendToCache(const QString &file);
 
+    // decodes the whole file synchronously, called from the precompute pool threads:
+    virtual bool decode(const QString &file, NWaveformPeaks &peaks) = 0;
+    bool precomputeCancelled();
+    void precomputeStop(); // to be called by the destructor of a subclass
+
 public:
     NAbstractWaveformBuilder();
     ~NAbstractWaveformBuilder();
 
-    const NWaveformPeaks &peaks() const { return m_peaks; }
+    const NWaveformPeaks &peaks() const { return m_peaksView; }
     void positionAndIndex(float &pos, int &index);
+    void precompute(const QStringList &files);
+    void setPrecomputeJobs(int jobs);
+    void precomputeWait();
+    void setCacheBudget(qint64 memoryBytes, qint64 diskBytes);
+    NWaveformCacheStats cacheStats() const;
 };
 
 #endif
@@ -0,0 +1,259 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#include "pitchShifter.h"
+
+#include <QtMath>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define N_X86_KERNELS
+#endif
+
+#define SEQUENCE_MSEC 40
+#define OVERLAP_MSEC 8
+#define SEEK_MSEC 15
+#define COARSE_STEP 4 // frames, of the first pass of the overlap search
+#define MIN_PITCH 0.5
+#define MAX_PITCH 2.0
+
+// Dot product of two blocks and the energy of the second one.
+typedef void (*NCorrelationKernel)(const float *a, const float *b, int count, float &dot,
+                                   float &energy);
+
+static void _correlationScalar(const float *a, const float *b, int count, float &dot,
+                               float &energy)
+{
+    float d = 0.0f;
+    float e = 0.0f;
+    for (int i = 0; i < count; ++i) {
+        d += a[i] * b[i];
+        e += b[i] * b[i];
+    }
+    dot = d;
+    energy = e;
+}
+
+#ifdef N_X86_KERNELS
+__attribute__((target("sse"))) static void _correlationSse(const float *a, const float *b,
+                                                          int count, float &dot, float &energy)
+{
+    __m128 vdot = _mm_setzero_ps();
+    __m128 venergy = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 va = _mm_loadu_ps(a + i);
+        __m128 vb = _mm_loadu_ps(b + i);
+        vdot = _mm_add_ps(vdot, _mm_mul_ps(va, vb));
+        venergy = _mm_add_ps(venergy, _mm_mul_ps(vb, vb));
+    }
+    float dots[4];
+    float energies[4];
+    _mm_storeu_ps(dots, vdot);
+    _mm_storeu_ps(energies, venergy);
+    _correlationScalar(a + i, b + i, count - i, dot, energy);
+    dot += dots[0] + dots[1] + dots[2] + dots[3];
+    energy += energies[0] + energies[1] + energies[2] + energies[3];
+}
+
+__attribute__((target("avx"))) static void _correlationAvx(const float *a, const float *b,
+                                                          int count, float &dot, float &energy)
+{
+    __m256 vdot = _mm256_setzero_ps();
+    __m256 venergy = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 va = _mm256_loadu_ps(a + i);
+        __m256 vb = _mm256_loadu_ps(b + i);
+        vdot = _mm256_add_ps(vdot, _mm256_mul_ps(va, vb));
+        venergy = _mm256_add_ps(venergy, _mm256_mul_ps(vb, vb));
+    }
+    float dots[8];
+    float energies[8];
+    _mm256_storeu_ps(dots, vdot);
+    _mm256_storeu_ps(energies, venergy);
+    _correlationScalar(a + i, b + i, count - i, dot, energy);
+    for (int j = 0; j < 8; ++j) {
+        dot += dots[j];
+        energy += energies[j];
+    }
+}
+#endif
+
+static NCorrelationKernel _correlationKernel()
+{
+#ifdef N_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) {
+        return _correlationAvx;
+    }
+    if (__builtin_cpu_supports("sse")) {
+        return _correlationSse;
+    }
+#endif
+    return _correlationScalar;
+}
+
+static const NCorrelationKernel _correlation = _correlationKernel();
+
+static inline void _append(QVector<float> &vector, const float *data, int count)
+{
+    int size = vector.size();
+    vector.resize(size + count);
+    memcpy(vector.data() + size, data, count * sizeof(float));
+}
+
+NPitchShifter::NPitchShifter()
+{
+    m_pitch = 1.0;
+    setFormat(2, 44100);
+}
+
+void NPitchShifter::setFormat(int channels, int sampleRate)
+{
+    m_channels = qMax(1, channels);
+    m_sequence = qMax(1, sampleRate) * SEQUENCE_MSEC / 1000;
+    m_overlap = qMax(1, sampleRate) * OVERLAP_MSEC / 1000;
+    m_seek = qMax(1, sampleRate) * SEEK_MSEC / 1000;
+
+    // the most input a sequence can wait for, the longest skip is at the lowest pitch:
+    int longestSkip = qCeil((m_sequence - m_overlap) / MIN_PITCH);
+    m_latency = qMax(m_seek + m_sequence, longestSkip + m_overlap) + m_overlap;
+    reset();
+}
+
+void NPitchShifter::setPitch(qreal pitch)
+{
+    m_pitch = qBound(MIN_PITCH, pitch, MAX_PITCH);
+}
+
+void NPitchShifter::reset()
+{
+    m_skipFraction = 0.0;
+    m_resamplePos = 0.0;
+    m_primed = false;
+    m_input.clear();
+    m_mid.fill(0.0f, m_overlap * m_channels);
+    m_stretched.clear();
+    m_output.fill(0.0f, m_latency * m_channels);
+}
+
+void NPitchShifter::process(float *samples, int frames)
+{
+    _append(m_input, samples, frames * m_channels);
+    stretch();
+    resample();
+
+    int count = qMin(frames, m_output.size() / m_channels) * m_channels;
+    memcpy(samples, m_output.constData(), count * sizeof(float));
+    memset(samples + count, 0, (frames * m_channels - count) * sizeof(float));
+    m_output.remove(0, count);
+}
+
+int NPitchShifter::bestOffset(const float *input) const
+{
+    // coarse pass over the whole seek window, then a fine one around the best match:
+    int count = m_overlap * m_channels;
+    int best = 0;
+    float bestScore = -1e30f;
+    for (int pass = 0; pass < 2; ++pass) {
+        int from = pass == 0 ? 0 : qMax(0, best - COARSE_STEP + 1);
+        int to = pass == 0 ? m_seek : qMin(m_seek, best + COARSE_STEP);
+        int step = pass == 0 ? COARSE_STEP : 1;
+        for (int offset = from; offset < to; offset += step) {
+            float dot;
+            float energy;
+            _correlation(m_mid.constData(), input + offset * m_channels, count, dot, energy);
+            float score = dot / qSqrt(energy + 1e-9f);
+            if (score > bestScore) {
+                bestScore = score;
+                best = offset;
+            }
+        }
+    }
+    return best;
+}
+
+void NPitchShifter::stretch()
+{
+    int available = m_input.size() / m_channels;
+    int consumed = 0;
+    int length = m_sequence - m_overlap; // output of a sequence
+    forever {
+        qreal nominalSkip = (qreal)length / m_pitch;
+        int skip = (int)(m_skipFraction + nominalSkip);
+        if (available - consumed < qMax(m_seek + m_sequence, skip + m_overlap)) {
+            break;
+        }
+
+        const float *input = m_input.constData() + consumed * m_channels;
+        int offset = 0;
+        if (m_primed) {
+            offset = bestOffset(input);
+        } else {
+            memcpy(m_mid.data(), input, m_overlap * m_channels * sizeof(float));
+            m_primed = true;
+        }
+        input += offset * m_channels;
+
+        int size = m_stretched.size();
+        m_stretched.resize(size + length * m_channels);
+        float *output = m_stretched.data() + size;
+        const float *mid = m_mid.constData();
+        for (int i = 0; i < m_overlap; ++i) {
+            float weight = (float)i / m_overlap;
+            for (int j = 0; j < m_channels; ++j) {
+                int k = i * m_channels + j;
+                output[k] = mid[k] + (input[k] - mid[k]) * weight;
+            }
+        }
+        memcpy(output + m_overlap * m_channels, input + m_overlap * m_channels,
+               (length - m_overlap) * m_channels * sizeof(float));
+        memcpy(m_mid.data(), input + length * m_channels, m_overlap * m_channels * sizeof(float));
+
+        m_skipFraction += nominalSkip - skip;
+        consumed += skip;
+    }
+    m_input.remove(0, consumed * m_channels);
+}
+
+void NPitchShifter::resample()
+{
+    int available = m_stretched.size() / m_channels;
+    int count = 0;
+    for (qreal pos = m_resamplePos; pos + 1.0 < available; pos += m_pitch) {
+        ++count;
+    }
+
+    int size = m_output.size();
+    m_output.resize(size + count * m_channels);
+    float *output = m_output.data() + size;
+    const float *input = m_stretched.constData();
+    for (int i = 0; i < count; ++i) {
+        int index = (int)m_resamplePos;
+        float fraction = m_resamplePos - index;
+        const float *a = input + index * m_channels;
+        const float *b = a + m_channels;
+        for (int j = 0; j < m_channels; ++j) {
+            output[i * m_channels + j] = a[j] + (b[j] - a[j]) * fraction;
+        }
+        m_resamplePos += m_pitch;
+    }
+
+    int dropped = qMin((int)m_resamplePos, available);
+    m_stretched.remove(0, dropped * m_channels);
+    m_resamplePos -= dropped;
+}
@@ -0,0 +1,58 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#ifndef N_PITCH_SHIFTER_H
+#define N_PITCH_SHIFTER_H
+
+#include <QVector>
+
+// Pitch shifting of interleaved float PCM in place: the audio is time-stretched by
+// the pitch factor with WSOLA (sequences spliced where they overlap best) and then
+// resampled back to its original length. The output is delayed by latency() frames,
+// every processed block gives back as many frames as it took.
+class NPitchShifter
+{
+private:
+    int m_channels;
+    int m_sequence; // frames
+    int m_overlap;
+    int m_seek;
+    int m_latency;
+    qreal m_pitch;
+    qreal m_skipFraction;
+    qreal m_resamplePos; // into m_stretched, in frames
+    bool m_primed;
+
+    QVector<float> m_input;
+    QVector<float> m_mid; // tail of the last sequence, overlapped with the next one
+    QVector<float> m_stretched;
+    QVector<float> m_output;
+
+    int bestOffset(const float *input) const;
+    void stretch();
+    void resample();
+
+public:
+    NPitchShifter();
+
+    void setFormat(int channels, int sampleRate); // resets
+    void setPitch(qreal pitch);                   // 0.5 to 2.0, applied from the next block on
+    qreal pitch() const { return m_pitch; }
+    int latency() const { return m_latency; }
+    void reset();
+    void process(float *samples, int frames);
+};
+
+#endif
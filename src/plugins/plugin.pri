@@ -4,7 +4,7 @@ CONFIG += plugin
 INCLUDEPATH += $$SRC_DIR $$SRC_DIR/interfaces $$SRC_DIR/plugins
 
 HEADERS += common.h
-SOURCES += $$SRC_DIR/common.cpp $$SRC_DIR/plugins/abstractWaveformBuilder.cpp $$SRC_DIR/waveformPeaks.cpp
+SOURCES += $$SRC_DIR/common.cpp $$SRC_DIR/plugins/abstractWaveformBuilder.cpp $$SRC_DIR/plugins/pitchShifter.cpp $$SRC_DIR/plugins/positionClock.cpp $$SRC_DIR/plugins/waveformCache.cpp $$SRC_DIR/waveformPeaks.cpp
 
 win32:DESTDIR = $$PROJECT_DIR/Plugins
 
@@ -0,0 +1,133 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#include "audioTap.h"
+
+#include <QFileInfo>
+#include <QMutex>
+#include <QVector>
+#include <cstring>
+
+#define BACKLOG_SEC 10
+
+namespace NAudioTap
+{
+    QMutex _mutex;
+    NAudioTapListener *_listener = NULL;
+    QString _file;
+    bool _finished = false;
+
+    // the beginning of the current stream, for a listener that starts late:
+    QVector<qint16> _backlog;
+    bool _backlogValid = false;
+    int _backlogRate = 0;
+    int _backlogChannels = 0;
+    qint64 _backlogDurationNsec = -1;
+} // namespace NAudioTap
+
+bool NAudioTap::isEnabled()
+{
+    QMutexLocker locker(&_mutex);
+    return _listener != NULL;
+}
+
+void NAudioTap::setListener(NAudioTapListener *listener)
+{
+    QMutexLocker locker(&_mutex);
+    _listener = listener;
+    _backlog.clear();
+    _backlogValid = false;
+}
+
+void NAudioTap::removeListener(NAudioTapListener *listener)
+{
+    QMutexLocker locker(&_mutex);
+    if (_listener == listener) {
+        _listener = NULL;
+        _backlog.clear();
+        _backlogValid = false;
+    }
+}
+
+void NAudioTap::streamStarted(const QString &file)
+{
+    QMutexLocker locker(&_mutex);
+    if (_listener && !_file.isEmpty() && !_finished) {
+        _listener->tapFinished(_file); // gapless switch, no EOS in between
+    }
+
+    _file = file.isEmpty() ? QString() : QFileInfo(file).absoluteFilePath();
+    _finished = false;
+    _backlog.clear();
+    _backlogValid = (_listener != NULL);
+    _backlogRate = 0;
+    _backlogChannels = 0;
+    _backlogDurationNsec = -1;
+}
+
+void NAudioTap::streamFinished()
+{
+    QMutexLocker locker(&_mutex);
+    if (_listener && !_file.isEmpty() && !_finished) {
+        _listener->tapFinished(_file);
+    }
+    _finished = true;
+}
+
+void NAudioTap::push(qint64 frame, qint64 durationNsec, int rate, const qint16 *pcm,
+                     int nChannels, int nFrames)
+{
+    QMutexLocker locker(&_mutex);
+    if (!_listener || _file.isEmpty()) {
+        return;
+    }
+
+    if (_backlogValid) {
+        if (_backlog.isEmpty()) {
+            _backlogRate = rate;
+            _backlogChannels = nChannels;
+        }
+        qint64 expected = _backlog.size() / _backlogChannels;
+        if (rate != _backlogRate || nChannels != _backlogChannels || frame != expected ||
+            expected + nFrames > (qint64)BACKLOG_SEC * rate) {
+            _backlog.clear();
+            _backlogValid = false;
+        } else {
+            int size = _backlog.size();
+            _backlog.resize(size + nFrames * nChannels);
+            memcpy(_backlog.data() + size, pcm, nFrames * nChannels * sizeof(qint16));
+            _backlogDurationNsec = durationNsec;
+        }
+    }
+
+    _listener->tapBuffer(_file, frame, durationNsec, rate, pcm, nChannels, nFrames);
+}
+
+bool NAudioTap::replay(const QString &file)
+{
+    QMutexLocker locker(&_mutex);
+    if (!_listener || !_backlogValid || _file != QFileInfo(file).absoluteFilePath()) {
+        return false;
+    }
+
+    if (!_backlog.isEmpty()) {
+        _listener->tapBuffer(_file, 0, _backlogDurationNsec, _backlogRate, _backlog.constData(),
+                             _backlogChannels, _backlog.size() / _backlogChannels);
+    }
+    if (_finished) {
+        _listener->tapFinished(_file);
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#ifndef N_AUDIO_TAP_H
+#define N_AUDIO_TAP_H
+
+#include <QString>
+
+class NAudioTapListener
+{
+public:
+    virtual ~NAudioTapListener() {}
+    virtual void tapBuffer(const QString &file, qint64 frame, qint64 durationNsec, int rate,
+                           const qint16 *pcm, int nChannels, int nFrames) = 0;
+    virtual void tapFinished(const QString &file) = 0;
+};
+
+// Hands the audio decoded by the playback engine over to the waveform builder.
+// All calls are thread-safe, listener callbacks are made from the streaming thread.
+namespace NAudioTap
+{
+    bool isEnabled();
+    void setListener(NAudioTapListener *listener); // NULL disables the tap
+    void removeListener(NAudioTapListener *listener);
+
+    void streamStarted(const QString &file);
+    void streamFinished();
+    void push(qint64 frame, qint64 durationNsec, int rate, const qint16 *pcm, int nChannels,
+              int nFrames);
+
+    // feeds the listener with the current stream from its very beginning, if it is still
+    // kept, and leaves it receiving the rest:
+    bool replay(const QString &file);
+} // namespace NAudioTap
+
+#endif
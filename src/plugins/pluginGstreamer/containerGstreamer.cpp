@@ -16,6 +16,7 @@
 #include "containerGstreamer.h"
 
 #include "common.h"
+#include "gstInit.h"
 #include "playbackEngineGstreamer.h"
 #include "waveformBuilderGstreamer.h"
 #ifdef _N_GSTREAMER_TAGREADER_PLUGIN_
@@ -37,6 +38,8 @@ NContainerGstreamer::~NContainerGstreamer()
 {
     foreach (NPlugin *plugin, m_plugins)
         delete plugin;
+
+    NGstInit::finish();
 }
 
 QList<NPlugin *> NContainerGstreamer::plugins() const
@@ -0,0 +1,52 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#include "gstBusBridge.h"
+
+#include <QCoreApplication>
+
+const QEvent::Type NGstMessageEvent::Type = (QEvent::Type)QEvent::registerEventType();
+
+NGstMessageEvent::NGstMessageEvent(GstMessage *message) : QEvent(Type)
+{
+    m_message = gst_message_ref(message);
+}
+
+NGstMessageEvent::~NGstMessageEvent()
+{
+    gst_message_unref(m_message);
+}
+
+static GstBusSyncReply _busSyncHandler(GstBus *, GstMessage *message, gpointer userData)
+{
+    // called from whichever thread posts, the event is queued in order:
+    QObject *receiver = reinterpret_cast<QObject *>(userData);
+    QCoreApplication::postEvent(receiver, new NGstMessageEvent(message));
+    return GST_BUS_DROP;
+}
+
+void NGstBusBridge::attach(GstElement *pipeline, QObject *receiver)
+{
+    GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    gst_bus_set_sync_handler(bus, _busSyncHandler, receiver, NULL);
+    gst_object_unref(bus);
+}
+
+void NGstBusBridge::detach(GstElement *pipeline)
+{
+    GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    gst_bus_set_sync_handler(bus, NULL, NULL, NULL);
+    gst_object_unref(bus);
+}
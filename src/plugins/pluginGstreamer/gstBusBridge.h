@@ -0,0 +1,45 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#ifndef N_GST_BUS_BRIDGE_H
+#define N_GST_BUS_BRIDGE_H
+
+#include <QEvent>
+#include <gst/gst.h>
+
+class QObject;
+
+class NGstMessageEvent : public QEvent
+{
+private:
+    GstMessage *m_message;
+
+public:
+    static const QEvent::Type Type;
+
+    NGstMessageEvent(GstMessage *message); // takes a reference
+    ~NGstMessageEvent();
+    GstMessage *message() const { return m_message; }
+};
+
+// Delivers bus messages to the event loop of a receiver as soon as they are posted,
+// instead of them waiting on the bus to be popped.
+namespace NGstBusBridge
+{
+    void attach(GstElement *pipeline, QObject *receiver);
+    void detach(GstElement *pipeline);
+} // namespace NGstBusBridge
+
+#endif
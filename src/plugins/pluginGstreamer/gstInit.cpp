@@ -0,0 +1,155 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#include "gstInit.h"
+
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <gst/gst.h>
+
+#include "common.h"
+
+// elements of the playback, waveform and tag reading pipelines:
+static const char *_warmUpElements[] = {"playbin",   "uridecodebin", "audioconvert",
+                                        "volume",    "tee",          "queue",
+                                        "identity",  "capsfilter",   "fakesink",
+                                        "autoaudiosink"};
+
+class NGstInitThread : public QThread
+{
+private:
+    int m_argc;
+    const char **m_argv;
+
+public:
+    NGstInitThread(int argc, const char **argv) : m_argc(argc), m_argv(argv) {}
+    void run();
+};
+
+namespace NGstInit
+{
+    enum State
+    {
+        NotStarted,
+        Running,
+        Done
+    };
+
+    static QMutex _mutex;
+    static QWaitCondition _done;
+    static State _state = NotStarted;
+    static bool _ok = false;
+    static QString _error;
+    static NGstInitThread *_thread = NULL;
+
+    static bool _init(int argc, const char **argv);
+    static void _warmUp();
+} // namespace NGstInit
+
+bool NGstInit::_init(int argc, const char **argv)
+{
+    GError *err = NULL;
+    bool ok = gst_init_check(&argc, (char ***)&argv, &err);
+    QString error;
+    if (!ok) {
+        error = err ? QString::fromUtf8(err->message) : QString("Unknown error");
+        if (err) {
+            g_error_free(err);
+        }
+    }
+
+    QMutexLocker locker(&_mutex);
+    _ok = ok;
+    _error = error;
+    _state = Done;
+    _done.wakeAll();
+    return ok;
+}
+
+void NGstInit::_warmUp()
+{
+    // loads the plugin libraries, which the registry scan alone doesn't:
+    for (size_t i = 0; i < sizeof(_warmUpElements) / sizeof(_warmUpElements[0]); ++i) {
+        GstElementFactory *factory = gst_element_factory_find(_warmUpElements[i]);
+        if (!factory) {
+            continue;
+        }
+        GstPluginFeature *loaded = gst_plugin_feature_load(GST_PLUGIN_FEATURE(factory));
+        if (loaded) {
+            gst_object_unref(loaded);
+        }
+        gst_object_unref(factory);
+    }
+}
+
+void NGstInitThread::run()
+{
+    // whoever waits is free to go once initialized, loading the elements is thread-safe:
+    if (NGstInit::_init(m_argc, m_argv)) {
+        NGstInit::_warmUp();
+    }
+}
+
+void NGstInit::start()
+{
+    QMutexLocker locker(&_mutex);
+    if (_state != NotStarted) {
+        return;
+    }
+    _state = Running;
+
+    int argc;
+    const char **argv;
+    NCore::cArgs(&argc, &argv);
+    _thread = new NGstInitThread(argc, argv);
+    _thread->start();
+}
+
+bool NGstInit::wait(QString *error)
+{
+    QMutexLocker locker(&_mutex);
+    if (_state == NotStarted) {
+        _state = Running;
+        int argc;
+        const char **argv;
+        NCore::cArgs(&argc, &argv);
+        locker.unlock();
+        _init(argc, argv);
+        locker.relock();
+    }
+
+    while (_state != Done) {
+        _done.wait(&_mutex);
+    }
+    if (error) {
+        *error = _error;
+    }
+    return _ok;
+}
+
+void NGstInit::finish()
+{
+    NGstInitThread *thread;
+    {
+        QMutexLocker locker(&_mutex);
+        thread = _thread;
+        _thread = NULL;
+    }
+    if (thread) {
+        thread->wait();
+        delete thread;
+    }
+}
@@ -0,0 +1,32 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#ifndef N_GST_INIT_H
+#define N_GST_INIT_H
+
+#include <QString>
+
+// GStreamer is initialized once for all the plugins of the container, on a background
+// thread started by the first plugin initialized, so that scanning the registry and loading
+// the elements doesn't hold up the window. Plugins wait for it only once they first
+// build a pipeline, from whichever thread.
+namespace NGstInit
+{
+    void start();
+    bool wait(QString *error = NULL); // initializes right away if not started
+    void finish();                    // before the container unloads
+} // namespace NGstInit
+
+#endif
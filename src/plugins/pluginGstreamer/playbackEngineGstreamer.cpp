@@ -17,27 +17,282 @@
 
 #include <QTimer>
 #include <QtGlobal>
+#include <QtMath>
+#include <gst/controller/gstdirectcontrolbinding.h>
+#include <gst/controller/gstinterpolationcontrolsource.h>
 #include <gst/pbutils/missing-plugins.h>
 
+#include "audioTap.h"
 #include "common.h"
+#include "gstBusBridge.h"
+#include "gstInit.h"
+#include "pitchShifter.h"
 
 #define NSEC_IN_MSEC 1000000
 #define CROSSFADING_MIN_DURATION_MSEC 1000 // 1 second
-#define SHORT_TICK_THRESHOLD_MSEC 30000    // 30 seconds
-#define SHORT_TICK_MSEC 20
-#define LONG_TICK_MSEC 100
+#define CROSSFADE_PREPARE_MSEC 1000        // ahead of the overlap, for the next media to preroll
+#define CROSSFADE_SCHEDULE_MSEC 200        // ahead of the overlap, for it to be scheduled
+#define CROSSFADE_MARGIN_MSEC 20           // least delay of a scheduled start
+#define CROSSFADE_STEPS 16                 // of the equal power fade curves
+#define FRAME_MSEC 40        // extrapolated position updates
+#define SAMPLE_MSEC 1000     // pipeline position queries
+#define POSITION_STEPS 10000 // resolution of positionChanged()
+#define SEEK_TIMEOUT_MSEC 1000 // of a seek that never completes
 #define STATE_CHANGE_DEBOUNCE_MSEC 50
-#define GST_BUS_POP_MSEC 50
+#define MIN_PITCH 0.5
+#define MAX_PITCH 2.0
+#define PITCH_PRECISION 10000
 
-static void _on_about_to_finish(GstElement *, gpointer userData)
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define PITCH_FORMAT "F32LE"
+#else
+#define PITCH_FORMAT "F32BE"
+#endif
+
+struct NTapContext
+{
+    NPlaybackEngineGStreamer *engine;
+    GstElement *playbin;
+    GstSegment segment;
+    gint64 durationNsec;
+    bool started; // announced to NAudioTap
+};
+
+static void _on_about_to_finish(GstElement *playbin, gpointer userData)
+{
+    // a playbin fading out is not waited for, the GUI thread may be stopping it meanwhile:
+    NPlaybackEngineGStreamer *engine = reinterpret_cast<NPlaybackEngineGStreamer *>(userData);
+    if (!engine->_tapping(playbin)) {
+        return;
+    }
+
+    // the next media has to be set before returning, the playlist lives in the GUI thread:
+    QMetaObject::invokeMethod(engine, "_aboutToFinish", Qt::BlockingQueuedConnection,
+                              Q_ARG(void *, playbin));
+}
+
+static GstPadProbeReturn _tapGate(GstPad *, GstPadProbeInfo *, gpointer)
+{
+    return NAudioTap::isEnabled() ? GST_PAD_PROBE_OK : GST_PAD_PROBE_DROP;
+}
+
+static void _tapStart(NTapContext *context)
+{
+    gchar *uri = NULL;
+    g_object_get(context->playbin, "current-uri", &uri, NULL);
+    gchar *path = uri ? g_filename_from_uri(uri, NULL, NULL) : NULL;
+    NAudioTap::streamStarted(path ? QString::fromUtf8(path) : QString());
+    g_free(path);
+    g_free(uri);
+    context->started = true;
+}
+
+static void _tapEvent(NTapContext *context, GstEvent *event, bool tapping)
+{
+    switch (GST_EVENT_TYPE(event)) {
+        case GST_EVENT_STREAM_START:
+            gst_segment_init(&context->segment, GST_FORMAT_TIME);
+            context->durationNsec = -1;
+            context->started = false;
+            if (tapping) {
+                _tapStart(context);
+            }
+            break;
+        case GST_EVENT_SEGMENT:
+            gst_event_copy_segment(event, &context->segment);
+            break;
+        case GST_EVENT_EOS:
+            if (tapping && context->started) {
+                NAudioTap::streamFinished();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void _tapBuffer(NTapContext *context, GstPad *pad, GstBuffer *buffer)
 {
-    NPlaybackEngineGStreamer *obj = reinterpret_cast<NPlaybackEngineGStreamer *>(userData);
-    if ((obj->durationMsec() < CROSSFADING_MIN_DURATION_MSEC) || obj->_nextMediaRequestBlocked()) {
+    if (!context->started) { // faded in, the stream started before it was tapped
+        _tapStart(context);
+    }
+
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (!caps) {
         return;
     }
-    obj->_emitNextMediaRequest();
+    int nChannels = 0;
+    int rate = 0;
+    GstStructure *structure = gst_caps_get_structure(caps, 0);
+    gst_structure_get_int(structure, "channels", &nChannels);
+    gst_structure_get_int(structure, "rate", &rate);
+    gst_caps_unref(caps);
+
+    if (nChannels <= 0 || rate <= 0 || !GST_BUFFER_PTS_IS_VALID(buffer)) {
+        return;
+    }
+
+    guint64 streamTime = gst_segment_to_stream_time(&context->segment, GST_FORMAT_TIME,
+                                                    GST_BUFFER_PTS(buffer));
+    if (streamTime == GST_CLOCK_TIME_NONE) {
+        return;
+    }
+
+    if (context->durationNsec < 0) {
+        gint64 duration;
+        if (gst_pad_peer_query_duration(pad, GST_FORMAT_TIME, &duration)) {
+            context->durationNsec = duration;
+        }
+    }
+
+    GstMapInfo mapInfo;
+    if (!gst_buffer_map(buffer, &mapInfo, GST_MAP_READ)) {
+        return;
+    }
+    NAudioTap::push(gst_util_uint64_scale_round(streamTime, rate, GST_SECOND),
+                    context->durationNsec, rate, (const qint16 *)mapInfo.data, nChannels,
+                    (mapInfo.size / sizeof(gint16)) / nChannels);
+    gst_buffer_unmap(buffer, &mapInfo);
+}
+
+static GstPadProbeReturn _tapProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
+{
+    NTapContext *context = reinterpret_cast<NTapContext *>(userData);
+    // only the current media is tapped, not the one fading out or being prepared:
+    bool tapping = context->engine->_tapping(context->playbin);
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+        if (tapping) {
+            _tapBuffer(context, pad, GST_PAD_PROBE_INFO_BUFFER(info));
+        }
+    } else {
+        _tapEvent(context, GST_PAD_PROBE_INFO_EVENT(info), tapping);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void _tapContextFree(gpointer data)
+{
+    delete reinterpret_cast<NTapContext *>(data);
+}
+
+// Equal power fade of the "fade_volume" element over [from, from + length] of stream time,
+// or no fade at all for a zero length:
+static void _setFade(GstElement *playbin, GstClockTime from, GstClockTime length, bool in)
+{
+    GstElement *volume = gst_bin_get_by_name(GST_BIN(playbin), "fade_volume");
+    if (!volume) {
+        return;
+    }
+
+    GstControlBinding *binding = gst_object_get_control_binding(GST_OBJECT(volume), "volume");
+    if (!binding) {
+        GstControlSource *source = gst_interpolation_control_source_new();
+        g_object_set(source, "mode", GST_INTERPOLATION_MODE_LINEAR, NULL);
+        gst_object_add_control_binding(GST_OBJECT(volume),
+                                       gst_direct_control_binding_new_absolute(GST_OBJECT(volume),
+                                                                               "volume", source));
+        gst_object_unref(source);
+        binding = gst_object_get_control_binding(GST_OBJECT(volume), "volume");
+    }
+
+    GstControlSource *source = NULL;
+    g_object_get(binding, "control-source", &source, NULL);
+    GstTimedValueControlSource *values = GST_TIMED_VALUE_CONTROL_SOURCE(source);
+    gst_timed_value_control_source_unset_all(values);
+    if (length > 0) {
+        for (int i = 0; i <= CROSSFADE_STEPS; ++i) {
+            qreal angle = M_PI_2 * i / CROSSFADE_STEPS;
+            gst_timed_value_control_source_set(values, from + length * i / CROSSFADE_STEPS,
+                                               in ? qSin(angle) : qCos(angle));
+        }
+    } else {
+        g_object_set(volume, "volume", 1.0, NULL);
+    }
+    gst_object_unref(source);
+    gst_object_unref(binding);
+    gst_object_unref(volume);
+}
+
+// Playback rate change in place, from the current running time on: nothing gets flushed
+// or decoded again. False where the pipeline can't, a flushing seek is needed then.
+static bool _setRate(GstElement *playbin, qreal rate)
+{
+#if GST_CHECK_VERSION(1, 18, 0)
+    return gst_element_seek(playbin, rate, GST_FORMAT_TIME, GST_SEEK_FLAG_INSTANT_RATE_CHANGE,
+                            GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE, GST_SEEK_TYPE_NONE,
+                            GST_CLOCK_TIME_NONE);
+#else
+    Q_UNUSED(playbin);
+    Q_UNUSED(rate);
+    return false;
+#endif
+}
+
+struct NPitchContext
+{
+    NPlaybackEngineGStreamer *engine;
+    NPitchShifter shifter;
+    int channels;
+    bool engaged; // since the first shift after a seek or a format change
+};
+
+static GstPadProbeReturn _pitchProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
+{
+    Q_UNUSED(pad);
+    NPitchContext *context = reinterpret_cast<NPitchContext *>(userData);
+    if (!(info->type & GST_PAD_PROBE_TYPE_BUFFER)) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+            GstCaps *caps;
+            gst_event_parse_caps(event, &caps);
+            int rate = 0;
+            GstStructure *structure = gst_caps_get_structure(caps, 0);
+            gst_structure_get_int(structure, "channels", &context->channels);
+            gst_structure_get_int(structure, "rate", &rate);
+            context->shifter.setFormat(context->channels, rate);
+            context->engaged = false;
+        } else if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP) {
+            context->engaged = false;
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    // passed through untouched until shifted, then delayed by the shifter latency once:
+    qreal pitch = context->engine->_pitchShift();
+    if (!context->engaged) {
+        if (qFuzzyCompare(pitch, 1.0) || context->channels <= 0) {
+            return GST_PAD_PROBE_OK;
+        }
+        context->shifter.reset();
+        context->engaged = true;
+    }
+    context->shifter.setPitch(pitch);
+
+    GstBuffer *buffer = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+    GST_PAD_PROBE_INFO_DATA(info) = buffer;
+    GstMapInfo mapInfo;
+    if (!gst_buffer_map(buffer, &mapInfo, GST_MAP_READWRITE)) {
+        return GST_PAD_PROBE_OK;
+    }
+    context->shifter.process((float *)mapInfo.data,
+                             (mapInfo.size / sizeof(float)) / context->channels);
+    gst_buffer_unmap(buffer, &mapInfo);
+    return GST_PAD_PROBE_OK;
+}
+
+static void _pitchContextFree(gpointer data)
+{
+    delete reinterpret_cast<NPitchContext *>(data);
 }
 
+#ifdef _TESTS_
+static GstPadProbeReturn _renderProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
+{
+    reinterpret_cast<NPlaybackEngineGStreamer *>(userData)->_render(pad, info);
+    return GST_PAD_PROBE_OK;
+}
+#endif
+
 N::PlaybackState NPlaybackEngineGStreamer::fromGstState(GstState state) const
 {
     switch (state) {
@@ -50,59 +305,100 @@ N::PlaybackState NPlaybackEngineGStreamer::fromGstState(GstState state) const
     }
 }
 
-void NPlaybackEngineGStreamer::init()
+GstElement *NPlaybackEngineGStreamer::createPlaybin()
 {
-    if (m_init) {
-        return;
-    }
+    GstElement *playbin = gst_element_factory_make("playbin", NULL);
+    g_signal_connect(playbin, "about-to-finish", G_CALLBACK(_on_about_to_finish), this);
+    gst_element_add_property_notify_watch(playbin, "volume", TRUE);
 
-    int argc;
-    const char **argv;
-    GError *err = NULL;
-    NCore::cArgs(&argc, &argv);
-    gst_init(&argc, (char ***)&argv);
-    if (!gst_init_check(&argc, (char ***)&argv, &err)) {
-        emit message(N::Critical, tr("Playback error"),
-                     err ? QString::fromUtf8(err->message) : tr("Unknown error"));
-        if (err) {
-            g_error_free(err);
-        }
-    }
-    m_playbin = gst_element_factory_make("playbin", NULL);
-    g_signal_connect(m_playbin, "about-to-finish", G_CALLBACK(_on_about_to_finish), this);
-    gst_element_add_property_notify_watch(m_playbin, "volume", TRUE);
+    // crossfade volume, pitch shift, and decoded audio tap for the waveform builder,
+    // converted only while someone listens:
+    GstElement *tap = gst_parse_bin_from_description(
+        "tee name=tap_tee ! queue ! volume name=fade_volume \
+         ! audioconvert ! audio/x-raw, format=" PITCH_FORMAT ", layout=interleaved \
+         ! identity name=pitch \
+         tap_tee. ! queue name=tap_queue leaky=downstream \
+         ! audioconvert ! audio/x-raw, format=S16LE \
+         ! fakesink name=tap_sink sync=false async=false",
+        TRUE, NULL);
+    if (tap) {
+        GstElement *queue = gst_bin_get_by_name(GST_BIN(tap), "tap_queue");
+        GstPad *pad = gst_element_get_static_pad(queue, "sink");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, _tapGate, NULL, NULL);
+        gst_object_unref(pad);
+        gst_object_unref(queue);
 
-    // FIXME: https://gitlab.freedesktop.org/gstreamer/gst-plugins-bad/-/issues/1798
-    //m_pitchElement = gst_element_factory_make("pitch", NULL);
-    m_pitchElement = NULL;
-    if (!m_pitchElement) {
-        //emit message(N::Critical, "Playback Engine", "Failed to create pitch element");
-    } else {
-        GstElement *sink = gst_element_factory_make("autoaudiosink", NULL);
-        GstElement *bin = gst_bin_new(NULL);
-        gst_bin_add_many(GST_BIN(bin), m_pitchElement, sink, NULL);
-        gst_element_link_many(m_pitchElement, sink, NULL);
+        NTapContext *context = new NTapContext;
+        context->engine = this;
+        context->playbin = playbin;
+        gst_segment_init(&context->segment, GST_FORMAT_TIME);
+        context->durationNsec = -1;
+        context->started = false;
+
+        GstElement *sink = gst_bin_get_by_name(GST_BIN(tap), "tap_sink");
+        pad = gst_element_get_static_pad(sink, "sink");
+        gst_pad_add_probe(pad,
+                          GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER |
+                                          GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                          _tapProbe, context, _tapContextFree);
+        gst_object_unref(pad);
+        gst_object_unref(sink);
+
+        NPitchContext *pitchContext = new NPitchContext;
+        pitchContext->engine = this;
+        pitchContext->channels = 0;
+        pitchContext->engaged = false;
 
-        GstPad *pad = gst_element_get_static_pad(m_pitchElement, "sink");
-        gst_element_add_pad(bin, gst_ghost_pad_new("sink", pad));
+        GstElement *pitch = gst_bin_get_by_name(GST_BIN(tap), "pitch");
+        pad = gst_element_get_static_pad(pitch, "sink");
+        gst_pad_add_probe(pad,
+                          GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER |
+                                          GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM |
+                                          GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+                          _pitchProbe, pitchContext, _pitchContextFree);
         gst_object_unref(pad);
+        gst_object_unref(pitch);
 
-        g_object_set(m_playbin, "audio-sink", bin, NULL);
+        g_object_set(playbin, "audio-filter", tap, NULL);
     }
 
 #ifdef _TESTS_
     GstElement *sink = gst_element_factory_make("fakesink", NULL);
     g_object_set(sink, "sync", TRUE, NULL);
-    g_object_set(m_playbin, "audio-sink", sink, NULL);
+    GstPad *pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(pad,
+                      GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER |
+                                      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM |
+                                      GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+                      _renderProbe, this, NULL);
+    gst_object_unref(pad);
+    g_object_set(playbin, "audio-sink", sink, NULL);
 
     sink = gst_element_factory_make("fakesink", NULL);
     g_object_set(sink, "sync", TRUE, NULL);
-    g_object_set(m_playbin, "video-sink", sink, NULL);
+    g_object_set(playbin, "video-sink", sink, NULL);
 #endif
 
+    NGstBusBridge::attach(playbin, this);
+
+    return playbin;
+}
+
+void NPlaybackEngineGStreamer::init()
+{
+    if (m_init) {
+        return;
+    }
+
+    // pipelines are created with the first media:
+    NGstInit::start();
+    m_playbin = NULL;
+    m_nextPlaybin = NULL;
+
     m_speed = 1.0;
     m_speedPostponed = false;
     m_pitch = 1.0;
+    m_pitchShift.storeRelease(PITCH_PRECISION);
     m_volume = -1.0;
     m_position = 0.0;
     m_gstState = GST_STATE_NULL;
@@ -111,9 +407,23 @@ void NPlaybackEngineGStreamer::init()
     m_currentContext = 0;
     m_bkpMedia = "";
     m_bkpContext = 0;
+    m_nextMedia = "";
+    m_nextContext = 0;
     m_durationNsec = GST_CLOCK_TIME_NONE;
     m_crossfading = false;
     m_nextMediaRequestBlock = false;
+    m_crossfadeMsec = 0;
+    m_crossfadeStage = CrossfadeIdle;
+    m_crossfadeSeeked = false;
+    m_seekInFlight = false;
+    m_seekRefinePending = false;
+    m_seekTargetNsec = 0;
+    m_seekIssuedNsec = 0;
+#ifdef _TESTS_
+    m_seekRequestNsec.storeRelease(0);
+    m_seeksIssued = 0;
+#endif
+    resetPosition();
 
     m_checkStatusTimer = new QTimer(this);
     connect(m_checkStatusTimer, SIGNAL(timeout()), this, SLOT(checkStatus()));
@@ -124,16 +434,6 @@ void NPlaybackEngineGStreamer::init()
     connect(m_emitStateTimer, &QTimer::timeout,
             [this]() { emit stateChanged(fromGstState(m_gstState)); });
 
-    m_gstBusPopTimer = new QTimer(this);
-    m_gstBusPopTimer->setInterval(GST_BUS_POP_MSEC);
-    connect(m_gstBusPopTimer, &QTimer::timeout, [this]() {
-        GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(m_playbin));
-        GstMessage *msg;
-        while ((msg = gst_bus_pop(bus)) != NULL) {
-            processGstMessage(msg);
-        }
-    });
-
     m_init = true;
 }
 
@@ -143,8 +443,69 @@ NPlaybackEngineGStreamer::~NPlaybackEngineGStreamer()
         return;
     }
 
+    if (!m_playbin) {
+        return;
+    }
+
     stop();
+    NGstBusBridge::detach(m_playbin);
+    NGstBusBridge::detach(m_nextPlaybin);
     gst_object_unref(m_playbin);
+    gst_object_unref(m_nextPlaybin);
+}
+
+bool NPlaybackEngineGStreamer::createPipelines()
+{
+    if (m_playbin) {
+        return true;
+    }
+
+    QString error;
+    if (!NGstInit::wait(&error)) {
+        emit message(N::Critical, tr("Playback error"), error);
+        return false;
+    }
+
+    // the second one prepares the next media and fades it in, while the first fades out:
+    m_playbin = createPlaybin();
+    m_nextPlaybin = createPlaybin();
+    m_tapPlaybin.storeRelease(m_playbin);
+    if (m_volume >= 0.0) {
+        g_object_set(m_playbin, "volume", m_volume, NULL);
+        g_object_set(m_nextPlaybin, "volume", m_volume, NULL);
+    }
+    return true;
+}
+
+void NPlaybackEngineGStreamer::resetPosition()
+{
+    m_positionClock.reset();
+    m_sampleTimeNsec = 0;
+    m_positionStep = -1;
+    m_tickSec = -1;
+}
+
+void NPlaybackEngineGStreamer::customEvent(QEvent *event)
+{
+    if (event->type() != NGstMessageEvent::Type) {
+        return;
+    }
+
+    // messages are told apart by the pipeline that posted them, which may have been
+    // swapped meanwhile:
+    GstMessage *msg = static_cast<NGstMessageEvent *>(event)->message();
+    GstObject *src = GST_MESSAGE_SRC(msg);
+    if (src == GST_OBJECT(m_nextPlaybin) ||
+        gst_object_has_as_ancestor(src, GST_OBJECT(m_nextPlaybin))) {
+        processNextGstMessage(msg);
+    } else {
+        processGstMessage(msg);
+    }
+}
+
+bool NPlaybackEngineGStreamer::_tapping(GstElement *playbin) const
+{
+    return m_tapPlaybin.loadAcquire() == playbin;
 }
 
 bool NPlaybackEngineGStreamer::gstSetFile(const QString &file, int context, bool prepareNext)
@@ -171,6 +532,8 @@ bool NPlaybackEngineGStreamer::gstSetFile(const QString &file, int context, bool
         m_currentContext = context;
         if (!prepareNext) {
             gst_element_set_state(m_playbin, GST_STATE_NULL);
+            // may have been given the system clock for a crossfade:
+            gst_pipeline_auto_clock(GST_PIPELINE(m_playbin));
         }
         g_object_set(m_playbin, "uri", uri, NULL);
         g_free(uri);
@@ -187,9 +550,17 @@ bool NPlaybackEngineGStreamer::gstSetFile(const QString &file, int context, bool
 
 void NPlaybackEngineGStreamer::setMedia(const QString &file, int context)
 {
+    if (!createPipelines()) {
+        return;
+    }
+
+    stopCrossfade();
     m_crossfading = false;
     m_position = 0.0;
     m_nextMediaRequestBlock = true;
+    m_seekInFlight = false;
+    m_seekRefinePending = false;
+    resetPosition();
 
     if (!gstSetFile(file, context, false)) {
         return;
@@ -198,6 +569,11 @@ void NPlaybackEngineGStreamer::setMedia(const QString &file, int context)
 
 void NPlaybackEngineGStreamer::nextMediaRespond(const QString &file, int context)
 {
+    if (m_crossfadeStage == CrossfadeRequested) {
+        prepareCrossfade(file, context);
+        return;
+    }
+
     if (!m_crossfading) {
         return;
     }
@@ -214,8 +590,23 @@ qreal NPlaybackEngineGStreamer::speed() const
 
 void NPlaybackEngineGStreamer::setSpeed(qreal speed)
 {
+    if (speed <= 0.0 || qFuzzyCompare(speed, m_speed)) {
+        return;
+    }
     m_speed = speed;
+    m_pitchShift.storeRelease(qRound(m_pitch / m_speed * PITCH_PRECISION));
+
+    if (m_crossfadeStage >= CrossfadePreparing && !_setRate(m_nextPlaybin, m_speed)) {
+        if (m_crossfadeStage != CrossfadeFading) {
+            m_nextMediaRequestBlock = false; // prepared once more, at the new speed
+        }
+        stopCrossfade();
+    }
+
     m_speedPostponed = true;
+    if (!m_seekInFlight) {
+        seek(false);
+    }
 }
 
 qreal NPlaybackEngineGStreamer::pitch() const
@@ -225,17 +616,31 @@ qreal NPlaybackEngineGStreamer::pitch() const
 
 void NPlaybackEngineGStreamer::setPitch(qreal pitch)
 {
-    if (!m_pitchElement) {
-        return;
-    }
-    m_pitch = pitch;
-    g_object_set(m_pitchElement, "pitch", m_pitch, NULL);
+    m_pitch = qBound(MIN_PITCH, pitch, MAX_PITCH);
+    // the audio sink plays a rate change by resampling, which shifts the pitch along:
+    m_pitchShift.storeRelease(qRound(m_pitch / m_speed * PITCH_PRECISION));
+}
+
+qreal NPlaybackEngineGStreamer::_pitchShift() const
+{
+    return (qreal)m_pitchShift.loadAcquire() / PITCH_PRECISION;
 }
 
 void NPlaybackEngineGStreamer::setVolume(qreal volume)
 {
     m_volume = qBound(0.0, volume, 1.0);
-    g_object_set(m_playbin, "volume", m_volume, NULL);
+    if (m_playbin) {
+        g_object_set(m_playbin, "volume", m_volume, NULL);
+        g_object_set(m_nextPlaybin, "volume", m_volume, NULL);
+    }
+}
+
+void NPlaybackEngineGStreamer::setCrossfadeMsec(qint64 msec)
+{
+    m_crossfadeMsec = qMax((qint64)0, msec);
+    if (!crossfadeEnabled() && m_crossfadeStage != CrossfadeFading) {
+        stopCrossfade();
+    }
 }
 
 qreal NPlaybackEngineGStreamer::volume() const
@@ -249,6 +654,11 @@ void NPlaybackEngineGStreamer::setPosition(qreal pos)
         return;
     }
 
+    if (m_crossfadeStage != CrossfadeIdle) {
+        stopCrossfade();
+        m_nextMediaRequestBlock = false;
+    }
+
     if (m_crossfading) {
         // abort cross-fading:
         if (!gstSetFile(m_bkpMedia, m_bkpContext, false)) {
@@ -259,6 +669,13 @@ void NPlaybackEngineGStreamer::setPosition(qreal pos)
     }
     m_position = pos;
     m_positionPostponed = true;
+#ifdef _TESTS_
+    m_seekRequestNsec.storeRelease(m_positionClock.now());
+#endif
+    // at once, unless one is still in flight, then the latest target follows it:
+    if (!m_seekInFlight) {
+        seek(false);
+    }
 }
 
 void NPlaybackEngineGStreamer::jump(qint64 msec)
@@ -267,6 +684,11 @@ void NPlaybackEngineGStreamer::jump(qint64 msec)
         return;
     }
 
+    if (m_crossfadeStage != CrossfadeIdle) {
+        stopCrossfade();
+        m_nextMediaRequestBlock = false;
+    }
+
     if (m_crossfading) {
         // abort cross-fading:
         if (!gstSetFile(m_bkpMedia, m_bkpContext, false)) {
@@ -274,8 +696,14 @@ void NPlaybackEngineGStreamer::jump(qint64 msec)
             return;
         }
     }
-    m_position += ((qreal)msec * NSEC_IN_MSEC) / m_durationNsec;
+    m_position = qBound(0.0, m_position + ((qreal)msec * NSEC_IN_MSEC) / m_durationNsec, 1.0);
     m_positionPostponed = true;
+#ifdef _TESTS_
+    m_seekRequestNsec.storeRelease(m_positionClock.now());
+#endif
+    if (!m_seekInFlight) {
+        seek(false);
+    }
 }
 
 qreal NPlaybackEngineGStreamer::position() const
@@ -294,8 +722,7 @@ void NPlaybackEngineGStreamer::play()
         return;
     }
 
-    m_gstBusPopTimer->start();
-    m_checkStatusTimer->start(LONG_TICK_MSEC);
+    m_checkStatusTimer->start(FRAME_MSEC);
     gst_element_set_state(m_playbin, GST_STATE_PLAYING);
 }
 
@@ -305,10 +732,13 @@ void NPlaybackEngineGStreamer::pause()
         return;
     }
 
+    if (m_crossfadeStage == CrossfadeFading) {
+        stopCrossfade();
+    }
     gst_element_set_state(m_playbin, GST_STATE_PAUSED);
 
     m_checkStatusTimer->stop();
-    m_gstBusPopTimer->stop();
+    m_positionClock.setRate(0.0, m_positionClock.now());
 
     m_gstState = GST_STATE_PAUSED;
     emit stateChanged(fromGstState(m_gstState));
@@ -318,18 +748,24 @@ void NPlaybackEngineGStreamer::pause()
 
 void NPlaybackEngineGStreamer::stop()
 {
+    stopCrossfade();
     m_crossfading = false;
     m_nextMediaRequestBlock = true;
-    gst_element_set_state(m_playbin, GST_STATE_NULL);
+    m_seekInFlight = false;
+    m_seekRefinePending = false;
+    if (m_playbin) {
+        gst_element_set_state(m_playbin, GST_STATE_NULL);
+    }
     m_durationNsec = 0;
     m_position = 0.0;
+    resetPosition();
+    m_positionClock.setRate(0.0, m_positionClock.now());
 
     m_gstState = GST_STATE_NULL;
     emit stateChanged(N::PlaybackStopped);
     emit positionChanged(m_position);
 
     m_checkStatusTimer->stop();
-    m_gstBusPopTimer->stop();
 }
 
 bool NPlaybackEngineGStreamer::hasMedia() const
@@ -386,6 +822,23 @@ void NPlaybackEngineGStreamer::processGstMessage(GstMessage *msg)
             }
             break;
         }
+        case GST_MESSAGE_ASYNC_DONE: {
+            if (GST_MESSAGE_SRC(msg) != GST_OBJECT(m_playbin) || !m_seekInFlight) {
+                break;
+            }
+            m_seekInFlight = false;
+            if (m_positionPostponed || m_speedPostponed) {
+                // requested while the previous one was in flight, only the latest is left:
+                seek(true);
+            }
+            if (!m_seekInFlight && !m_positionPostponed && m_seekRefinePending) {
+                // landed on a key unit while scrubbing, now exactly on the target:
+                m_position = (qreal)m_seekTargetNsec / m_durationNsec;
+                m_positionPostponed = true;
+                seek(false);
+            }
+            break;
+        }
         case GST_MESSAGE_DURATION_CHANGED: {
             m_durationNsec = GST_CLOCK_TIME_NONE;
             break;
@@ -397,6 +850,7 @@ void NPlaybackEngineGStreamer::processGstMessage(GstMessage *msg)
                 m_speedPostponed = true;
             }
             m_durationNsec = GST_CLOCK_TIME_NONE;
+            resetPosition();
             emit mediaChanged(m_currentMedia, m_currentContext);
             break;
         }
@@ -424,6 +878,13 @@ void NPlaybackEngineGStreamer::processGstMessage(GstMessage *msg)
                     m_gstState = newState;
                     m_emitStateTimer->start();
                 }
+                m_positionClock.setRate(newState == GST_STATE_PLAYING ? m_speed : 0.0,
+                                        m_positionClock.now());
+                if (newState == GST_STATE_PLAYING &&
+                    GST_ELEMENT_START_TIME(m_playbin) == GST_CLOCK_TIME_NONE) {
+                    // started at a scheduled time by a crossfade, pausing works as usual again:
+                    gst_element_set_start_time(m_playbin, 0);
+                }
             }
             break;
         }
@@ -432,6 +893,126 @@ void NPlaybackEngineGStreamer::processGstMessage(GstMessage *msg)
     }
 }
 
+void NPlaybackEngineGStreamer::processNextGstMessage(GstMessage *msg)
+{
+    switch (GST_MESSAGE_TYPE(msg)) {
+        case GST_MESSAGE_ASYNC_DONE: {
+            if (m_crossfadeStage != CrossfadePreparing ||
+                GST_MESSAGE_SRC(msg) != GST_OBJECT(m_nextPlaybin)) {
+                break;
+            }
+            if (m_speed != 1.0 && !m_crossfadeSeeked) {
+                // prerolls once more, at the playback speed:
+                m_crossfadeSeeked = true;
+                if (gst_element_seek(m_nextPlaybin, m_speed, GST_FORMAT_TIME,
+                                     GstSeekFlags(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE),
+                                     GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE,
+                                     GST_CLOCK_TIME_NONE)) {
+                    break;
+                }
+            }
+            m_crossfadeStage = CrossfadeReady;
+            break;
+        }
+        case GST_MESSAGE_EOS: {
+            if (m_crossfadeStage == CrossfadeFading) {
+                stopCrossfade();
+            }
+            break;
+        }
+        case GST_MESSAGE_ERROR: {
+            // the current media plays to its end, the playlist then moves on and the error
+            // gets reported the usual way:
+            stopCrossfade();
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+bool NPlaybackEngineGStreamer::crossfadeEnabled() const
+{
+    // shorter media are played gapless:
+    return m_crossfadeMsec > 0 && GST_CLOCK_TIME_IS_VALID(m_durationNsec) &&
+           durationMsec() >= m_crossfadeMsec * 2 + CROSSFADE_PREPARE_MSEC;
+}
+
+void NPlaybackEngineGStreamer::prepareCrossfade(const QString &file, int context)
+{
+    gchar *uri = NULL;
+    if (QFile(file).exists()) {
+        uri = g_filename_to_uri(QFileInfo(file).absoluteFilePath().toUtf8().constData(), NULL,
+                                NULL);
+    }
+    if (!uri) {
+        // left for the playlist to deal with once the current media finishes:
+        m_crossfadeStage = CrossfadeIdle;
+        return;
+    }
+
+    m_nextMedia = file;
+    m_nextContext = context;
+    m_crossfadeSeeked = false;
+    m_crossfadeStage = CrossfadePreparing;
+
+    gdouble volume;
+    g_object_get(m_playbin, "volume", &volume, NULL);
+    gst_element_set_state(m_nextPlaybin, GST_STATE_NULL);
+    g_object_set(m_nextPlaybin, "uri", uri, "volume", volume, NULL);
+    g_free(uri);
+    gst_element_set_state(m_nextPlaybin, GST_STATE_PAUSED);
+}
+
+void NPlaybackEngineGStreamer::startCrossfade()
+{
+    gint64 gstPos;
+    if (!gst_element_query_position(m_playbin, GST_FORMAT_TIME, &gstPos)) {
+        return; // retried on the next check
+    }
+
+    // the next media is started at the system clock time the overlap begins, the fades are
+    // applied in the stream time of either:
+    GstClock *clock = gst_system_clock_obtain();
+    GstClockTime now = gst_clock_get_time(clock);
+    qint64 remainingNsec = qMax((qint64)0, (qint64)((m_durationNsec - gstPos) / m_speed));
+    qint64 fadeNsec = qBound((qint64)0, remainingNsec - CROSSFADE_MARGIN_MSEC * NSEC_IN_MSEC,
+                             m_crossfadeMsec * NSEC_IN_MSEC);
+    GstClockTime fadeStreamNsec = fadeNsec * m_speed;
+
+    _setFade(m_playbin, m_durationNsec - fadeStreamNsec, fadeStreamNsec, false);
+    _setFade(m_nextPlaybin, 0, fadeStreamNsec, true);
+
+    gst_pipeline_use_clock(GST_PIPELINE(m_nextPlaybin), clock);
+    gst_element_set_start_time(m_nextPlaybin, GST_CLOCK_TIME_NONE);
+    gst_element_set_base_time(m_nextPlaybin, now + remainingNsec - fadeNsec);
+    gst_element_set_state(m_nextPlaybin, GST_STATE_PLAYING);
+    gst_object_unref(clock);
+
+    // from now on the next media is the current one, and the outgoing one is left to fade:
+    qSwap(m_playbin, m_nextPlaybin);
+    m_tapPlaybin.storeRelease(m_playbin);
+    m_crossfadeStage = CrossfadeFading;
+    m_crossfading = false;
+    m_nextMediaRequestBlock = false;
+    m_currentMedia = m_nextMedia;
+    m_currentContext = m_nextContext;
+    m_durationNsec = GST_CLOCK_TIME_NONE;
+    m_position = 0.0;
+    resetPosition();
+    emit mediaChanged(m_currentMedia, m_currentContext);
+}
+
+void NPlaybackEngineGStreamer::stopCrossfade()
+{
+    if (m_crossfadeStage != CrossfadeIdle && m_crossfadeStage != CrossfadeRequested) {
+        gst_element_set_state(m_nextPlaybin, GST_STATE_NULL);
+        _setFade(m_nextPlaybin, 0, 0, true);
+        _setFade(m_playbin, 0, 0, true);
+    }
+    m_crossfadeStage = CrossfadeIdle;
+}
+
 void NPlaybackEngineGStreamer::checkStatus()
 {
     if (!GST_CLOCK_TIME_IS_VALID(m_durationNsec)) {
@@ -439,31 +1020,117 @@ void NPlaybackEngineGStreamer::checkStatus()
     }
 
     if (GST_CLOCK_TIME_IS_VALID(m_durationNsec)) {
-        gint64 gstPos = 0;
-        if (gst_element_query_position(m_playbin, GST_FORMAT_TIME, &gstPos)) {
+        // the pipeline is queried now and then, in between the position is extrapolated:
+        qint64 now = m_positionClock.now();
+        if (m_seekInFlight && now - m_seekIssuedNsec >= SEEK_TIMEOUT_MSEC * NSEC_IN_MSEC) {
+            m_seekInFlight = false; // its ASYNC_DONE got lost
+        }
+        if (!m_seekInFlight &&
+            (!m_positionClock.isValid() || now - m_sampleTimeNsec >= SAMPLE_MSEC * NSEC_IN_MSEC ||
+             m_positionPostponed || m_speedPostponed)) {
+            gint64 gstPos = 0;
+            if (gst_element_query_position(m_playbin, GST_FORMAT_TIME, &gstPos)) {
+                m_positionClock.sample(gstPos, now);
+                m_sampleTimeNsec = now;
+            }
+        }
+
+        gint64 gstPos = qMin(m_positionClock.position(now), (qint64)m_durationNsec);
+        if (m_positionClock.isValid() && m_gstState == GST_STATE_PLAYING && !m_positionPostponed &&
+            crossfadeEnabled()) {
+            qint64 remainingMsec = (m_durationNsec - gstPos) / NSEC_IN_MSEC / m_speed;
+            if (m_crossfadeStage == CrossfadeIdle && !m_nextMediaRequestBlock &&
+                remainingMsec <= m_crossfadeMsec + CROSSFADE_PREPARE_MSEC) {
+                // answered right away with nextMediaRespond():
+                m_nextMediaRequestBlock = true;
+                m_crossfadeStage = CrossfadeRequested;
+                emit nextMediaRequested();
+            } else if (m_crossfadeStage == CrossfadeReady &&
+                       remainingMsec <= m_crossfadeMsec + CROSSFADE_SCHEDULE_MSEC) {
+                startCrossfade();
+                return;
+            }
+        }
+
+        if (m_positionClock.isValid()) {
+            // only as often as it makes a difference to the slider and the labels:
             if (!m_positionPostponed) {
                 m_position = (qreal)gstPos / m_durationNsec;
-                emit positionChanged(m_position);
+                int step = qRound(m_position * POSITION_STEPS);
+                if (step != m_positionStep) {
+                    m_positionStep = step;
+                    emit positionChanged(m_position);
+                }
+            }
+            qint64 msec = gstPos / NSEC_IN_MSEC * m_speed;
+            if (msec / 1000 != m_tickSec) {
+                m_tickSec = msec / 1000;
+                emit tick(msec);
             }
-            emit tick(gstPos / NSEC_IN_MSEC * m_speed);
         }
 
-        if (m_positionPostponed || m_speedPostponed) {
-            if (m_positionPostponed) {
-                gstPos = m_position * m_durationNsec;
-            }
-            gst_element_seek(m_playbin, m_speed, GST_FORMAT_TIME,
-                             GstSeekFlags(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
-                                          GST_SEEK_FLAG_SNAP_NEAREST),
-                             GST_SEEK_TYPE_SET, gstPos, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+        if ((m_positionPostponed || m_speedPostponed) && !m_seekInFlight &&
+            m_gstState >= GST_STATE_PAUSED && !seek(false)) {
+            // prerolled but not seekable, given up:
             m_positionPostponed = false;
             m_speedPostponed = false;
         }
+    }
+}
 
-        if (m_durationNsec / NSEC_IN_MSEC <= SHORT_TICK_THRESHOLD_MSEC) {
-            m_checkStatusTimer->setInterval(SHORT_TICK_MSEC);
-        }
+bool NPlaybackEngineGStreamer::seek(bool scrubbing)
+{
+    if (m_gstState < GST_STATE_PAUSED || !GST_CLOCK_TIME_IS_VALID(m_durationNsec) ||
+        m_durationNsec <= 0) {
+        return false; // retried by checkStatus() once prerolled
+    }
+
+    qint64 now = m_positionClock.now();
+    if (!m_positionPostponed && _setRate(m_playbin, m_speed)) {
+        m_speedPostponed = false;
+        m_positionClock.setRate(m_gstState == GST_STATE_PLAYING ? m_speed : 0.0, now);
+        return true;
     }
+
+    gint64 gstPos = 0;
+    if (m_positionPostponed) {
+        gstPos = m_position * m_durationNsec;
+    } else if (m_positionClock.isValid()) {
+        gstPos = qMin(m_positionClock.position(now), (qint64)m_durationNsec);
+    } else if (!gst_element_query_position(m_playbin, GST_FORMAT_TIME, &gstPos)) {
+        return false;
+    }
+
+    // key units are good enough while scrubbing, the last target gets refined afterwards:
+    bool accurateFormat =
+        m_accurateSeekFormats.contains(QFileInfo(m_currentMedia).suffix(), Qt::CaseInsensitive);
+    bool accurate = accurateFormat && !scrubbing;
+    GstSeekFlags flags = GstSeekFlags(GST_SEEK_FLAG_FLUSH |
+                                      (accurate ? GST_SEEK_FLAG_ACCURATE
+                                                : GST_SEEK_FLAG_KEY_UNIT |
+                                                      GST_SEEK_FLAG_SNAP_NEAREST));
+    if (!gst_element_seek(m_playbin, m_speed, GST_FORMAT_TIME, flags, GST_SEEK_TYPE_SET, gstPos,
+                          GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE)) {
+        return false;
+    }
+    m_positionPostponed = false;
+    m_speedPostponed = false;
+    m_seekInFlight = true;
+    m_seekRefinePending = accurateFormat && !accurate;
+    m_seekTargetNsec = gstPos;
+    m_seekIssuedNsec = now;
+#ifdef _TESTS_
+    ++m_seeksIssued;
+#endif
+
+    m_positionClock.sample(gstPos, now);
+    m_positionClock.setRate(m_gstState == GST_STATE_PLAYING ? m_speed : 0.0, now);
+    return true;
+}
+
+void NPlaybackEngineGStreamer::setAccurateSeekFormats(const QStringList &formats)
+{
+    m_accurateSeekFormats = formats;
 }
 
 void NPlaybackEngineGStreamer::fail()
@@ -476,13 +1143,125 @@ void NPlaybackEngineGStreamer::fail()
     m_currentContext = 0;
 }
 
-void NPlaybackEngineGStreamer::_emitNextMediaRequest()
+void NPlaybackEngineGStreamer::_aboutToFinish(void *playbin)
 {
+    // crossfades are requested by checkStatus() instead:
+    if (playbin != m_playbin || m_nextMediaRequestBlock || crossfadeEnabled() ||
+        durationMsec() < CROSSFADING_MIN_DURATION_MSEC) {
+        return;
+    }
     m_crossfading = true;
     emit nextMediaRequested();
 }
 
-bool NPlaybackEngineGStreamer::_nextMediaRequestBlocked()
+#ifdef _TESTS_
+void NPlaybackEngineGStreamer::_render(GstPad *pad, GstPadProbeInfo *info)
+{
+    QMutexLocker locker(&m_renderMutex);
+
+    if (!(info->type & GST_PAD_PROBE_TYPE_BUFFER)) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_STREAM_START) {
+            RenderSpan span;
+            span.pad = pad;
+            gst_segment_init(&span.segment, GST_FORMAT_TIME);
+            span.baseTime = GST_CLOCK_TIME_NONE;
+            span.start = GST_CLOCK_TIME_NONE;
+            span.end = GST_CLOCK_TIME_NONE;
+            span.rate = 0;
+            span.seeked = false;
+            m_renderSpans << span;
+            return;
+        }
+    }
+
+    int index = m_renderSpans.size() - 1;
+    while (index >= 0 && m_renderSpans.at(index).pad != pad) {
+        --index;
+    }
+    if (index < 0) {
+        return;
+    }
+    RenderSpan &span = m_renderSpans[index];
+
+    if (!(info->type & GST_PAD_PROBE_TYPE_BUFFER)) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT) {
+            gst_event_copy_segment(event, &span.segment);
+        } else if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP) {
+            span.start = GST_CLOCK_TIME_NONE;
+            span.seeked = true;
+        }
+        return;
+    }
+
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!GST_BUFFER_PTS_IS_VALID(buffer) || !GST_BUFFER_DURATION_IS_VALID(buffer)) {
+        return;
+    }
+    guint64 start = gst_segment_to_running_time(&span.segment, GST_FORMAT_TIME,
+                                                GST_BUFFER_PTS(buffer));
+    guint64 end = gst_segment_to_running_time(&span.segment, GST_FORMAT_TIME,
+                                              GST_BUFFER_PTS(buffer) +
+                                                  GST_BUFFER_DURATION(buffer));
+    if (start == GST_CLOCK_TIME_NONE || end == GST_CLOCK_TIME_NONE) {
+        return;
+    }
+
+    if (!span.rate) {
+        GstCaps *caps = gst_pad_get_current_caps(pad);
+        if (caps) {
+            gst_structure_get_int(gst_caps_get_structure(caps, 0), "rate", &span.rate);
+            gst_caps_unref(caps);
+        }
+    }
+    if (span.start == GST_CLOCK_TIME_NONE) {
+        span.start = start;
+    }
+    if (span.seeked) {
+        span.seeked = false;
+        // first audio since the seek, the sink syncs it right away:
+        qint64 requestNsec = m_seekRequestNsec.fetchAndStoreOrdered(0);
+        if (requestNsec > 0) {
+            m_seekLatencies << m_positionClock.now() - requestNsec;
+        }
+    }
+    span.end = end;
+    // the prerolled buffer comes before the base time is known:
+    span.baseTime = gst_element_get_base_time(GST_PAD_PARENT(pad));
+}
+
+QVariantList NPlaybackEngineGStreamer::_renderedSpans() const
+{
+    QMutexLocker locker(&m_renderMutex);
+
+    QVariantList spans;
+    foreach (const RenderSpan &span, m_renderSpans) {
+        if (span.start == GST_CLOCK_TIME_NONE) {
+            continue;
+        }
+        QVariantMap map;
+        map["start"] = (qint64)(span.baseTime + span.start);
+        map["end"] = (qint64)(span.baseTime + span.end);
+        map["rate"] = span.rate;
+        spans << map;
+    }
+    return spans;
+}
+
+QVariantList NPlaybackEngineGStreamer::_seekLatencies() const
 {
-    return m_nextMediaRequestBlock;
+    QMutexLocker locker(&m_renderMutex);
+
+    QVariantList latencies;
+    foreach (qint64 nsec, m_seekLatencies) {
+        latencies << nsec;
+    }
+    return latencies;
 }
+
+int NPlaybackEngineGStreamer::_seeksIssued() const
+{
+    return m_seeksIssued;
+}
+#endif
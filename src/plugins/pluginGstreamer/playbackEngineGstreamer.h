@@ -21,8 +21,10 @@
 #include "global.h"
 #include "playbackEngineInterface.h"
 #include "plugin.h"
+#include "positionClock.h"
 
 class QTimer;
+struct NTapContext;
 
 class NPlaybackEngineGStreamer : public NPlaybackEngineInterface, public NPlugin
 {
@@ -30,15 +32,25 @@ class NPlaybackEngineGStreamer : public NPlaybackEngineInterface, public NPlugin
     Q_INTERFACES(NPlaybackEngineInterface NPlugin)
 
 private:
+    enum CrossfadeStage
+    {
+        CrossfadeIdle,
+        CrossfadeRequested, // waiting for nextMediaRespond()
+        CrossfadePreparing, // the next media is prerolling
+        CrossfadeReady,     // prerolled, waiting for the outgoing one to near its end
+        CrossfadeFading     // both are playing, the outgoing one is in m_nextPlaybin
+    };
+
     GstElement *m_playbin;
-    GstElement *m_pitchElement;
+    GstElement *m_nextPlaybin;
+    QAtomicPointer<GstElement> m_tapPlaybin; // m_playbin, for the streaming threads
 
     QTimer *m_checkStatusTimer;
     QTimer *m_emitStateTimer;
-    QTimer *m_gstBusPopTimer;
     qreal m_speed;
     bool m_speedPostponed;
     qreal m_pitch;
+    QAtomicInt m_pitchShift; // of the shifter, in 1/PITCH_PRECISION, read by the streaming threads
     qreal m_volume;
     qreal m_position;
     bool m_positionPostponed;
@@ -46,16 +58,58 @@ private:
     gint64 m_durationNsec;
     bool m_crossfading;
     bool m_nextMediaRequestBlock;
+    qint64 m_crossfadeMsec;
+    CrossfadeStage m_crossfadeStage;
+    bool m_crossfadeSeeked;
+    bool m_seekInFlight;       // until its ASYNC_DONE, further targets wait for it
+    bool m_seekRefinePending;  // the last one was a key unit one, while scrubbing
+    gint64 m_seekTargetNsec;
+    qint64 m_seekIssuedNsec;   // monotonic
+    QStringList m_accurateSeekFormats;
+    NPositionClock m_positionClock;
+    qint64 m_sampleTimeNsec;
+    int m_positionStep;
+    qint64 m_tickSec;
 
     QString m_currentMedia;
     int m_currentContext;
     QString m_bkpMedia;
     int m_bkpContext;
+    QString m_nextMedia;
+    int m_nextContext;
+
+#ifdef _TESTS_
+    struct RenderSpan
+    {
+        GstPad *pad;
+        GstSegment segment;
+        GstClockTime baseTime;
+        GstClockTime start; // running time
+        GstClockTime end;
+        int rate;
+        bool seeked; // flushed, waiting for the first buffer
+    };
+    QList<RenderSpan> m_renderSpans;
+    QList<qint64> m_seekLatencies;
+    QAtomicInteger<qint64> m_seekRequestNsec; // monotonic, of the latest target
+    int m_seeksIssued;
+    mutable QMutex m_renderMutex;
+#endif
 
     N::PlaybackState fromGstState(GstState state) const;
+    GstElement *createPlaybin();
+    bool createPipelines();
     bool gstSetFile(const QString &file, int context, bool prepareNext);
     void processGstMessage(GstMessage *msg);
+    void processNextGstMessage(GstMessage *msg);
+    bool crossfadeEnabled() const;
+    void prepareCrossfade(const QString &file, int context);
+    void startCrossfade();
+    void stopCrossfade();
+    bool seek(bool scrubbing);
     void fail();
+    void resetPosition();
+    void customEvent(QEvent *event);
 
 public:
     NPlaybackEngineGStreamer(QObject *parent = NULL) : NPlaybackEngineInterface(parent) {}
@@ -74,8 +128,15 @@ public:
     Q_INVOKABLE qreal speed() const;
     Q_INVOKABLE qreal pitch() const;
 
-    void _emitNextMediaRequest();
-    bool _nextMediaRequestBlocked();
+    Q_INVOKABLE void _aboutToFinish(void *playbin);
+    bool _tapping(GstElement *playbin) const;
+    qreal _pitchShift() const;
+#ifdef _TESTS_
+    void _render(GstPad *pad, GstPadProbeInfo *info);
+    Q_INVOKABLE QVariantList _renderedSpans() const;
+    Q_INVOKABLE QVariantList _seekLatencies() const;
+    Q_INVOKABLE int _seeksIssued() const;
+#endif
 
 public slots:
     Q_INVOKABLE void setMedia(const QString &file, int context);
@@ -84,7 +145,9 @@ public slots:
     Q_INVOKABLE void setPosition(qreal pos);
     Q_INVOKABLE void jump(qint64 msec);
     Q_INVOKABLE void setSpeed(qreal speed);
-    Q_INVOKABLE void setPitch(qreal speed);
+    Q_INVOKABLE void setPitch(qreal pitch);
+    Q_INVOKABLE void setCrossfadeMsec(qint64 msec);
+    Q_INVOKABLE void setAccurateSeekFormats(const QStringList &formats);
 
     Q_INVOKABLE void play();
     Q_INVOKABLE void stop();
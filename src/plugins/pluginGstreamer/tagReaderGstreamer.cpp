@@ -21,6 +21,7 @@
 #include <QTextCodec>
 
 #include "common.h"
+#include "gstInit.h"
 
 void NTagReaderGstreamer::init()
 {
@@ -31,18 +32,7 @@ void NTagReaderGstreamer::init()
     m_isValid = false;
     m_taglist = NULL;
 
-    int argc;
-    const char **argv;
-    GError *err = NULL;
-    NCore::cArgs(&argc, &argv);
-    if (!gst_init_check(&argc, (char ***)&argv, &err)) {
-        qWarning() << "NTagReaderGstreamer :: gst_init_check error ::"
-                   << (err ? QString::fromUtf8(err->message) : "unknown error");
-        if (err) {
-            g_error_free(err);
-        }
-        return;
-    }
+    NGstInit::start();
 
     m_init = true;
 }
@@ -57,6 +47,12 @@ void NTagReaderGstreamer::setSource(const QString &file)
     m_isValid = false;
     m_path = "";
 
+    QString error;
+    if (!NGstInit::wait(&error)) {
+        qWarning() << "NTagReaderGstreamer :: gst_init_check error ::" << error;
+        return;
+    }
+
     QFileInfo fileInfo(file);
     if (!fileInfo.exists()) {
         return;
@@ -16,70 +16,122 @@
 #include "waveformBuilderGstreamer.h"
 
 #include "common.h"
-
-#if defined Q_OS_WIN || defined Q_OS_MAC
-#include <QTimer>
-#endif
+#include "gstBusBridge.h"
+#include "gstInit.h"
 
 #include <QDebug>
 #include <QFile>
 
-static QMutex _mutex;
+#define TAP_GAP_MSEC 20
+#define TAP_END_MSEC 100
+#define TAP_POSITION_SCALE 1000000
 
-static void _handleBuffer(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
+static GstPadProbeReturn _handleBuffer(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
 {
-    QMutexLocker locker(&_mutex);
+    NWaveformBuilderGstreamer *obj = reinterpret_cast<NWaveformBuilderGstreamer *>(userData);
+    if (!(info->type & GST_PAD_PROBE_TYPE_BUFFER)) {
+        if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_FLUSH_STOP) {
+            obj->handleFlush();
+        }
+        return GST_PAD_PROBE_OK;
+    }
 
-    int nChannels;
-    GstStructure *structure = gst_caps_get_structure(gst_pad_get_current_caps(pad), 0);
-    gst_structure_get_int(structure, "channels", &nChannels);
+    int nChannels = 0;
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    gst_structure_get_int(gst_caps_get_structure(caps, 0), "channels", &nChannels);
+    gst_caps_unref(caps);
 
     GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
     GstMapInfo mapInfo;
-    gst_buffer_map(buffer, &mapInfo, GST_MAP_READ);
-    gint16 *pcmBuffer = (gint16 *)mapInfo.data;
-    int nSamples = (mapInfo.size / sizeof(gint16)) / nChannels;
+    if (nChannels > 0 && gst_buffer_map(buffer, &mapInfo, GST_MAP_READ)) {
+        obj->handleBuffer((gint16 *)mapInfo.data, nChannels,
+                          (mapInfo.size / sizeof(gint16)) / nChannels);
+        gst_buffer_unmap(buffer, &mapInfo);
+    }
 
-    NWaveformBuilderGstreamer *obj = reinterpret_cast<NWaveformBuilderGstreamer *>(userData);
-    obj->handleBuffer(pcmBuffer, nChannels, nSamples);
-    gst_buffer_unmap(buffer, &mapInfo);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn _precomputeBuffer(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
+{
+    int nChannels = 0;
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    gst_structure_get_int(gst_caps_get_structure(caps, 0), "channels", &nChannels);
+    gst_caps_unref(caps);
+
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstMapInfo mapInfo;
+    if (nChannels > 0 && gst_buffer_map(buffer, &mapInfo, GST_MAP_READ)) {
+        NWaveformPeaks *peaks = reinterpret_cast<NWaveformPeaks *>(userData);
+        peaks->appendBlock((gint16 *)mapInfo.data, nChannels,
+                           (mapInfo.size / sizeof(gint16)) / nChannels);
+        gst_buffer_unmap(buffer, &mapInfo);
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+static GstElement *_createPipeline(const QString &file, GstPadProbeType probeType,
+                                   GstPadProbeCallback callback, gpointer userData)
+{
+    if (!NGstInit::wait()) {
+        return NULL;
+    }
+
+    GstElement *pipeline = gst_parse_launch("uridecodebin name=w_uridecodebin \
+                                             ! audioconvert ! audio/x-raw, format=S16LE \
+                                             ! fakesink name=w_sink",
+                                            NULL);
+
+    gchar *uri = g_filename_to_uri(QFileInfo(file).absoluteFilePath().toUtf8().constData(), NULL,
+                                   NULL);
+    GstElement *uridecodebin = gst_bin_get_by_name(GST_BIN(pipeline), "w_uridecodebin");
+    g_object_set(uridecodebin, "uri", uri, NULL);
+    gst_object_unref(uridecodebin);
+    g_free(uri);
+
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "w_sink");
+    GstPad *pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(pad, probeType, callback, userData, NULL);
+    gst_object_unref(sink);
+    gst_object_unref(pad);
+
+    return pipeline;
 }
 
 void NWaveformBuilderGstreamer::handleBuffer(gint16 *pcmBuffer, int nChannels, int nSamples)
 {
-    for (int i = 0; i < nSamples; ++i) {
-        qint32 pcmValue = 0;
-        for (int j = 0; j < nChannels; ++j) {
-            const qint16 *ptr = pcmBuffer + i * nChannels + j;
-            pcmValue += *ptr;
-        }
-        qreal realValue = -((qreal)pcmValue / nChannels) / (1 << 15);
-        m_peaks.append(realValue);
+    if (m_seekPending.loadAcquire()) {
+        return;
+    }
+    m_peaks.appendBlock(pcmBuffer, nChannels, nSamples);
+    if (peaksPublish()) {
+        QMetaObject::invokeMethod(this, "peaksAdvanced", Qt::QueuedConnection);
     }
 }
 
+void NWaveformBuilderGstreamer::handleFlush()
+{
+    m_seekPending.storeRelease(0);
+}
+
 void NWaveformBuilderGstreamer::init()
 {
     if (m_init) {
         return;
     }
 
-    int argc;
-    const char **argv;
-    GError *err = NULL;
-    NCore::cArgs(&argc, &argv);
-    gst_init(&argc, (char ***)&argv);
-    if (!gst_init_check(&argc, (char ***)&argv, &err)) {
-        qCritical() << "WaveformBuilder :: error ::" << QString::fromUtf8(err->message);
-        if (err) {
-            g_error_free(err);
-        }
-    }
+    NGstInit::start();
 
     m_playbin = NULL;
-
-    m_timer = new QTimer(this);
-    connect(m_timer, SIGNAL(timeout()), this, SLOT(update()));
+    m_sharedDecode = false;
+    m_seekPending.storeRelease(0);
+    m_tapState.storeRelease(TapIdle);
+    m_tapPosition.storeRelease(0);
+    m_tapGeneration = 0;
+    m_tapFrames = 0;
+    m_tapRate = 0;
+    m_tapDurationNsec = -1;
 
     reset();
 
@@ -88,22 +140,42 @@ void NWaveformBuilderGstreamer::init()
 
 NWaveformBuilderGstreamer::~NWaveformBuilderGstreamer()
 {
+    precomputeStop();
+
     if (!m_init) {
         return;
     }
 
+    NAudioTap::removeListener(this);
     stop();
 }
 
+void NWaveformBuilderGstreamer::setSharedDecode(bool enable)
+{
+    m_sharedDecode = enable;
+    NAudioTap::setListener(enable ? this : NULL);
+}
+
+void NWaveformBuilderGstreamer::tapStop()
+{
+    // waits out a callback in progress, which never waits for this thread in turn:
+    while (!m_tapState.testAndSetOrdered(TapArmed, TapIdle) &&
+           m_tapState.loadAcquire() != TapIdle) {
+        QThread::yieldCurrentThread();
+    }
+    ++m_tapGeneration; // calls posted by the tap so far are stale
+}
+
 void NWaveformBuilderGstreamer::stop()
 {
-    m_timer->stop();
+    tapStop();
 
     if (m_playbin) {
         if (m_peaks.isCompleted()) {
             peaksAppendToCache(m_currentFile);
         }
 
+        NGstBusBridge::detach(m_playbin);
         gst_element_set_state(m_playbin, GST_STATE_NULL);
         gst_object_unref(m_playbin);
         m_playbin = NULL;
@@ -120,6 +192,7 @@ void NWaveformBuilderGstreamer::start(const QString &file)
     stop();
 
     if (peaksFindFromCache(file)) {
+        emit peaksCompleted();
         return;
     }
     if (!QFileInfo(file).exists()) {
@@ -127,38 +200,201 @@ void NWaveformBuilderGstreamer::start(const QString &file)
     }
     m_currentFile = file;
 
-    m_playbin = gst_parse_launch("uridecodebin name=w_uridecodebin \
-                                  ! audioconvert ! audio/x-raw, format=S16LE \
-                                  ! fakesink name=w_sink",
-                                 NULL);
+    reset();
 
-    gchar *uri = g_filename_to_uri(QFileInfo(file).absoluteFilePath().toUtf8().constData(), NULL,
-                                   NULL);
-    GstElement *uridecodebin = gst_bin_get_by_name(GST_BIN(m_playbin), "w_uridecodebin");
-    g_object_set(uridecodebin, "uri", uri, NULL);
-    gst_object_unref(uridecodebin);
+    m_tapFile = QFileInfo(file).absoluteFilePath();
+    m_tapFrames = 0;
+    m_tapRate = 0;
+    m_tapDurationNsec = -1;
+    m_tapPosition.storeRelease(0);
+
+    if (m_sharedDecode) {
+        m_tapState.storeRelease(TapArmed);
+        // the playback engine has been tapped since the stream start:
+        if (NAudioTap::replay(file)) {
+            return;
+        }
+        tapStop();
+    }
 
-    GstElement *sink = gst_bin_get_by_name(GST_BIN(m_playbin), "w_sink");
-    GstPad *pad = gst_element_get_static_pad(sink, "sink");
-    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)_handleBuffer, this,
-                      NULL);
-    gst_object_unref(sink);
-    gst_object_unref(pad);
+    startPipeline(0);
+}
+
+void NWaveformBuilderGstreamer::startPipeline(qint64 fromNsec)
+{
+    // the buffer prerolled from the start of the file is flushed by the seek:
+    m_seekPending.storeRelease(fromNsec > 0);
+    m_playbin = _createPipeline(m_currentFile,
+                                GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER |
+                                                GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+                                _handleBuffer, this);
+    if (!m_playbin) {
+        return;
+    }
+    NGstBusBridge::attach(m_playbin, this);
+
+    if (fromNsec > 0) {
+        gst_element_set_state(m_playbin, GST_STATE_PAUSED);
+        gst_element_get_state(m_playbin, NULL, NULL, GST_SECOND);
+        if (!gst_element_seek_simple(m_playbin, GST_FORMAT_TIME,
+                                     GstSeekFlags(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE),
+                                     fromNsec)) {
+            // not seekable, decode it all instead:
+            NGstBusBridge::detach(m_playbin);
+            gst_element_set_state(m_playbin, GST_STATE_NULL);
+            gst_object_unref(m_playbin);
+            m_playbin = NULL;
+            reset();
+            startPipeline(0);
+            return;
+        }
+    }
 
-    reset();
     QThread::start();
 
-    if (!m_timer->isActive()) {
-        m_timer->start(100);
+    gst_element_set_state(m_playbin, GST_STATE_PLAYING);
+}
+
+void NWaveformBuilderGstreamer::tapBuffer(const QString &file, qint64 frame, qint64 durationNsec,
+                                          int rate, const qint16 *pcm, int nChannels,
+                                          int nFrames)
+{
+    if (!m_tapState.testAndSetAcquire(TapArmed, TapBusy)) {
+        return;
+    }
+    if (file != m_tapFile) {
+        m_tapState.storeRelease(TapArmed);
+        return;
     }
 
-    gst_element_set_state(m_playbin, GST_STATE_PLAYING);
+    if (m_tapRate != rate) {
+        if (m_tapRate != 0) { // resampled stream, frames don't match anymore
+            tapHandOver();
+            return;
+        }
+        m_tapRate = rate;
+    }
+    m_tapDurationNsec = durationNsec;
+
+    if (frame > m_tapFrames + (qint64)rate * TAP_GAP_MSEC / 1000) {
+        // seeked forward, let a separate decoder cover the rest:
+        tapHandOver();
+        return;
+    }
+
+    // skip what is already there, e.g. after seeking backwards:
+    qint64 skip = qMax((qint64)0, m_tapFrames - frame);
+    if (skip < nFrames) {
+        m_peaks.appendBlock(pcm + skip * nChannels, nChannels, nFrames - (int)skip);
+        m_tapFrames += nFrames - skip;
+        if (m_tapDurationNsec > 0) {
+            qreal pos = (qreal)m_tapFrames * GST_SECOND / m_tapRate / m_tapDurationNsec;
+            m_tapPosition.storeRelease((int)(qMin(1.0, pos) * TAP_POSITION_SCALE));
+        }
+        if (peaksPublish()) {
+            QMetaObject::invokeMethod(this, "peaksAdvanced", Qt::QueuedConnection);
+        }
+    }
+
+    m_tapState.storeRelease(TapArmed);
+}
+
+void NWaveformBuilderGstreamer::tapFinished(const QString &file)
+{
+    if (!m_tapState.testAndSetAcquire(TapArmed, TapBusy)) {
+        return;
+    }
+    if (file != m_tapFile) {
+        m_tapState.storeRelease(TapArmed);
+        return;
+    }
+
+    qint64 tappedNsec = m_tapRate > 0 ? gst_util_uint64_scale(m_tapFrames, GST_SECOND, m_tapRate)
+                                      : 0;
+    qint64 endNsec = m_tapDurationNsec - TAP_END_MSEC * (qint64)GST_MSECOND;
+    if (m_tapRate == 0 || (m_tapDurationNsec > 0 && tappedNsec < endNsec)) {
+        // stopped before the end:
+        tapHandOver();
+        return;
+    }
+
+    QMetaObject::invokeMethod(this, "tapCompleted", Qt::QueuedConnection,
+                              Q_ARG(int, m_tapGeneration));
+    m_tapState.storeRelease(TapIdle); // m_peaks goes back to the GUI thread
+}
+
+void NWaveformBuilderGstreamer::tapHandOver()
+{
+    qint64 fromNsec = m_tapRate > 0 ? gst_util_uint64_scale(m_tapFrames, GST_SECOND, m_tapRate)
+                                    : 0;
+    QMetaObject::invokeMethod(this, "decodeRemainder", Qt::QueuedConnection,
+                              Q_ARG(int, m_tapGeneration), Q_ARG(qint64, fromNsec));
+    m_tapState.storeRelease(TapIdle);
+}
+
+void NWaveformBuilderGstreamer::tapCompleted(int generation)
+{
+    if (generation != m_tapGeneration || m_playbin) {
+        return;
+    }
+    peaksComplete();
+#if defined(QT_DEBUG) && !defined(QT_NO_DEBUG)
+    qDebug() << "WaveformBuilder ::"
+             << "completed from playback" << m_peaks.size();
+#endif
+    peaksAppendToCache(m_currentFile);
+    emit peaksCompleted();
+}
+
+void NWaveformBuilderGstreamer::decodeRemainder(int generation, qint64 fromNsec)
+{
+    if (generation != m_tapGeneration || m_playbin || m_peaks.isCompleted()) {
+        return;
+    }
+    startPipeline(fromNsec);
+}
+
+bool NWaveformBuilderGstreamer::decode(const QString &file, NWaveformPeaks &peaks)
+{
+    if (!m_init) {
+        return false;
+    }
+
+    GstElement *pipeline = _createPipeline(file, GST_PAD_PROBE_TYPE_BUFFER, _precomputeBuffer,
+                                           &peaks);
+    if (!pipeline) {
+        return false;
+    }
+    GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    bool completed = false;
+    while (!precomputeCancelled()) {
+        GstMessage *msg = gst_bus_timed_pop_filtered(bus, 100 * GST_MSECOND,
+                                                     GstMessageType(GST_MESSAGE_EOS |
+                                                                    GST_MESSAGE_ERROR));
+        if (!msg) {
+            continue;
+        }
+        completed = (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+        gst_message_unref(msg);
+        break;
+    }
+
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    if (completed) {
+        peaks.complete();
+    }
+    return completed;
 }
 
 qreal NWaveformBuilderGstreamer::position() const
 {
     if (!m_playbin) {
-        return 0;
+        return (qreal)m_tapPosition.loadAcquire() / TAP_POSITION_SCALE;
     }
 
     if (!isRunning()) {
@@ -172,37 +408,58 @@ qreal NWaveformBuilderGstreamer::position() const
     return (qreal)pos / len;
 }
 
-void NWaveformBuilderGstreamer::update()
+void NWaveformBuilderGstreamer::customEvent(QEvent *event)
 {
-    GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(m_playbin));
-    GstMessage *msg = gst_bus_pop_filtered(bus, GstMessageType(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
-    if (msg) {
-        switch (GST_MESSAGE_TYPE(msg)) {
-            case GST_MESSAGE_EOS:
-                m_peaks.complete();
+    if (event->type() != NGstMessageEvent::Type || !m_playbin) {
+        return;
+    }
+
+    // messages of an already stopped pipeline may still be queued:
+    GstMessage *msg = static_cast<NGstMessageEvent *>(event)->message();
+    if (!gst_object_has_as_ancestor(GST_MESSAGE_SRC(msg), GST_OBJECT(m_playbin)) &&
+        GST_MESSAGE_SRC(msg) != GST_OBJECT(m_playbin)) {
+        return;
+    }
+
+    switch (GST_MESSAGE_TYPE(msg)) {
+        case GST_MESSAGE_EOS:
+            // the streaming thread is done with m_peaks once EOS is posted:
+            peaksComplete();
 #if defined(QT_DEBUG) && !defined(QT_NO_DEBUG)
-                qDebug() << "WaveformBuilder ::"
-                         << "completed" << m_peaks.size();
+            qDebug() << "WaveformBuilder ::"
+                     << "completed" << m_peaks.size();
 #endif
-                stop();
-                break;
-            case GST_MESSAGE_ERROR: {
-                gchar *debug;
-                GError *err = NULL;
-
-                gst_message_parse_error(msg, &err, &debug);
-                g_free(debug);
-
-                qWarning() << "WaveformBuilder :: error ::" << QString::fromUtf8(err->message);
-                if (err) {
-                    g_error_free(err);
-                }
-                break;
+            stop();
+            emit peaksCompleted();
+            break;
+        case GST_MESSAGE_ERROR: {
+            gchar *debug;
+            GError *err = NULL;
+
+            gst_message_parse_error(msg, &err, &debug);
+            g_free(debug);
+
+            qWarning() << "WaveformBuilder :: error ::" << QString::fromUtf8(err->message);
+            if (err) {
+                g_error_free(err);
             }
-            default:
-                break;
+            break;
         }
-        gst_message_unref(msg);
+        default:
+            break;
     }
-    gst_object_unref(bus);
 }
+
+#ifdef _TESTS_
+QVariantList NWaveformBuilderGstreamer::_decodedBins(const QString &file)
+{
+    QVariantList bins;
+    NWaveformPeaks peaks;
+    if (decode(file, peaks)) {
+        for (int i = 0; i < peaks.size(0); ++i) {
+            bins << peaks.positive(0, i) << peaks.negative(0, i);
+        }
+    }
+    return bins;
+}
+#endif
@@ -19,15 +19,15 @@
 #include <gst/gst.h>
 
 #include "abstractWaveformBuilder.h"
+#include "audioTap.h"
 #include "global.h"
 #include "plugin.h"
 #include "waveformBuilderInterface.h"
 
-class QTimer;
-
 class NWaveformBuilderGstreamer : public NWaveformBuilderInterface,
                                   public NPlugin,
-                                  public NAbstractWaveformBuilder
+                                  public NAbstractWaveformBuilder,
+                                  public NAudioTapListener
 {
     Q_OBJECT
     Q_INTERFACES(NWaveformBuilderInterface NPlugin)
@@ -35,11 +35,35 @@ class NWaveformBuilderGstreamer : public NWaveformBuilderInterface,
 private:
     GstElement *m_playbin;
     QString m_currentFile;
-    QTimer *m_timer;
     qreal position() const;
+    bool decode(const QString &file, NWaveformPeaks &peaks);
+    void startPipeline(qint64 fromNsec);
+    void customEvent(QEvent *event);
+
+    enum TapState
+    {
+        TapIdle = 0,  // the GUI thread sets the tap up
+        TapArmed = 1, // waiting for the next callback
+        TapBusy = 2   // a callback owns the tap fields and m_peaks
+    };
+
+    bool m_sharedDecode;
+    QAtomicInt m_seekPending; // the buffer prerolled before the seek of startPipeline() is dropped
+
+    // handed over between the GUI thread and the tap callbacks by m_tapState, without locking:
+    QAtomicInt m_tapState;
+    QAtomicInt m_tapPosition; // in TAP_POSITION_SCALE parts, for the GUI thread
+    int m_tapGeneration;      // of the posted calls, changed by the GUI thread while TapIdle
+    QString m_tapFile;
+    qint64 m_tapFrames;
+    int m_tapRate;
+    qint64 m_tapDurationNsec;
+    void tapStop();
+    void tapHandOver();
 
 private slots:
-    void update();
+    void tapCompleted(int generation);
+    void decodeRemainder(int generation, qint64 fromNsec);
 
 public:
     NWaveformBuilderGstreamer(QObject *parent = NULL) : NWaveformBuilderInterface(parent) {}
@@ -56,8 +80,29 @@ public:
         NAbstractWaveformBuilder::positionAndIndex(pos, index);
     }
     const NWaveformPeaks &peaks() const { return NAbstractWaveformBuilder::peaks(); }
+    void precompute(const QStringList &files) { NAbstractWaveformBuilder::precompute(files); }
+    void setPrecomputeJobs(int jobs) { NAbstractWaveformBuilder::setPrecomputeJobs(jobs); }
+    void precomputeWait() { NAbstractWaveformBuilder::precomputeWait(); }
+    void setCacheBudget(qint64 memoryBytes, qint64 diskBytes)
+    {
+        NAbstractWaveformBuilder::setCacheBudget(memoryBytes, diskBytes);
+    }
+    NWaveformCacheStats cacheStats() const { return NAbstractWaveformBuilder::cacheStats(); }
+    void setSharedDecode(bool enable);
 
     void handleBuffer(gint16 *pcmBuffer, int nChannels, int nSamples);
+    void handleFlush();
+    void tapBuffer(const QString &file, qint64 frame, qint64 durationNsec, int rate,
+                   const qint16 *pcm, int nChannels, int nFrames);
+    void tapFinished(const QString &file);
+
+#ifdef _TESTS_
+    Q_INVOKABLE QVariantList _decodedBins(const QString &file); // of a separate full decode
+#endif
+
+signals:
+    void peaksAdvanced();
+    void peaksCompleted();
 };
 
 #endif
@@ -30,24 +30,19 @@ void NCoverReaderTaglib::init()
     }
 
     m_init = true;
-    NTaglib::_tagRef = NULL;
 }
 
 void NCoverReaderTaglib::setSource(const QString &file)
 {
-    if (NTaglib::_filePath == file) {
+    if (m_filePath == file) {
         return;
     }
-    NTaglib::_filePath = file;
+    m_filePath = file;
 
-    if (NTaglib::_tagRef) {
-        delete NTaglib::_tagRef;
+    if (m_tagRef) {
+        delete m_tagRef;
     }
-#ifdef WIN32
-    NTaglib::_tagRef = new TagLib::FileRef(reinterpret_cast<const wchar_t *>(file.constData()));
-#else
-    NTaglib::_tagRef = new TagLib::FileRef(file.toUtf8().data());
-#endif
+    m_tagRef = NTaglib::open(file);
 }
 
 NCoverReaderTaglib::~NCoverReaderTaglib()
@@ -56,15 +51,15 @@ NCoverReaderTaglib::~NCoverReaderTaglib()
         return;
     }
 
-    if (NTaglib::_tagRef) {
-        delete NTaglib::_tagRef;
-        NTaglib::_tagRef = NULL;
+    if (m_tagRef) {
+        delete m_tagRef;
+        m_tagRef = NULL;
     }
 }
 
 bool NCoverReaderTaglib::isValid() const
 {
-    return (NTaglib::_tagRef && NTaglib::_tagRef->file() && NTaglib::_tagRef->file()->isValid());
+    return NTaglib::isValid(m_tagRef);
 }
 
 QImage NCoverReaderTaglib::fromTagBytes(const TagLib::ByteVector &data) const
@@ -191,7 +186,7 @@ QList<QImage> NCoverReaderTaglib::getImages() const
         return images;
     }
 
-    TagLib::File *tagFile = NTaglib::_tagRef->file();
+    TagLib::File *tagFile = m_tagRef->file();
 
     if (auto *file = dynamic_cast<TagLib::APE::File *>(tagFile)) {
         if (file->APETag()) {
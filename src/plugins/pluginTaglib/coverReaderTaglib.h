@@ -37,6 +37,9 @@ class NCoverReaderTaglib : public NCoverReaderInterface, public NPlugin
     Q_INTERFACES(NCoverReaderInterface NPlugin)
 
 private:
+    TagLib::FileRef *m_tagRef;
+    QString m_filePath;
+
     QImage fromTagBytes(const TagLib::ByteVector &data) const;
     QList<QImage> fromApe(TagLib::APE::Tag *tag) const;
     QList<QImage> fromAsf(TagLib::ASF::Tag *tag) const;
@@ -46,7 +49,7 @@ private:
     QList<QImage> fromVorbis(TagLib::Tag *tag) const;
 
 public:
-    NCoverReaderTaglib(QObject *parent = 0) : NCoverReaderInterface(parent) {}
+    NCoverReaderTaglib(QObject *parent = 0) : NCoverReaderInterface(parent), m_tagRef(NULL) {}
     ~NCoverReaderTaglib();
 
     void init();
@@ -16,10 +16,26 @@
 #ifndef N_TAGLIB_FILE_REF_H
 #define N_TAGLIB_FILE_REF_H
 
+#include <fileref.h>
+
+#include <QString>
+
 namespace NTaglib
 {
-    extern TagLib::FileRef *_tagRef;
-    extern QString _filePath;
+    // every reader opens files of its own, TagLib handles are not to be shared between threads:
+    inline TagLib::FileRef *open(const QString &file)
+    {
+#ifdef WIN32
+        return new TagLib::FileRef(reinterpret_cast<const wchar_t *>(file.constData()));
+#else
+        return new TagLib::FileRef(file.toUtf8().data());
+#endif
+    }
+
+    inline bool isValid(const TagLib::FileRef *tagRef)
+    {
+        return tagRef && tagRef->file() && tagRef->file()->isValid();
+    }
 } // namespace NTaglib
 
 #endif
@@ -25,18 +25,51 @@
 #include <wavproperties.h>
 
 #include <QFileInfo>
+#include <QSemaphore>
 #include <QTextCodec>
+#include <QThread>
+#include <QVector>
 
 #include "tagLibFileRef.h"
 
-TagLib::FileRef *NTaglib::_tagRef;
-QString NTaglib::_filePath;
+// Reads the files of a readMany() call that are left, one at a time.
+class NTaglibReadWorker : public QRunnable
+{
+private:
+    const NTagReaderTaglib *m_reader;
+    const QStringList &m_files;
+    const QString &m_tags;
+    const QString &m_encoding;
+    NTagData *m_results;
+    QAtomicInt &m_next;
+    QSemaphore &m_done;
+
+public:
+    NTaglibReadWorker(const NTagReaderTaglib *reader, const QStringList &files,
+                      const QString &tags, const QString &encoding, NTagData *results,
+                      QAtomicInt &next, QSemaphore &done)
+        : m_reader(reader), m_files(files), m_tags(tags), m_encoding(encoding), m_results(results),
+          m_next(next), m_done(done)
+    {
+    }
+
+    void run()
+    {
+        int i;
+        while ((i = m_next.fetchAndAddRelaxed(1)) < m_files.size()) {
+            m_results[i] = m_reader->read(m_files.at(i), m_tags, m_encoding);
+        }
+        m_done.release();
+    }
+};
 
 NTagReaderTaglib::NTagReaderTaglib(QObject *parent) : NTagReaderInterface(parent)
 {
+    m_tagRef = NULL;
     m_isValid = false;
     m_codec = nullptr;
     m_utf8Codec = QTextCodec::codecForName("UTF-8");
+    m_readPool.setMaxThreadCount(QThread::idealThreadCount());
 }
 
 void NTagReaderTaglib::init()
@@ -46,37 +79,30 @@ void NTagReaderTaglib::init()
     }
 
     m_init = true;
-    NTaglib::_tagRef = NULL;
 }
 
 void NTagReaderTaglib::setSource(const QString &file)
 {
-    if (NTaglib::_filePath == file) {
+    if (m_filePath == file) {
         return;
     }
 
     m_isValid = false;
 
-    if (NTaglib::_tagRef) {
-        delete NTaglib::_tagRef;
-        NTaglib::_tagRef = NULL;
+    if (m_tagRef) {
+        delete m_tagRef;
+        m_tagRef = NULL;
     }
 
-    NTaglib::_filePath = "";
+    m_filePath = "";
 
     if (!QFileInfo(file).exists()) {
         return;
     }
 
-    NTaglib::_filePath = file;
-
-#ifdef WIN32
-    NTaglib::_tagRef = new TagLib::FileRef(reinterpret_cast<const wchar_t *>(file.constData()));
-#else
-    NTaglib::_tagRef = new TagLib::FileRef(file.toUtf8().data());
-#endif
-
-    m_isValid = NTaglib::_tagRef->file() && NTaglib::_tagRef->file()->isValid();
+    m_filePath = file;
+    m_tagRef = NTaglib::open(file);
+    m_isValid = NTaglib::isValid(m_tagRef);
 }
 
 void NTagReaderTaglib::setEncoding(const QString &encoding)
@@ -90,21 +116,24 @@ NTagReaderTaglib::~NTagReaderTaglib()
         return;
     }
 
-    if (NTaglib::_tagRef) {
-        delete NTaglib::_tagRef;
-        NTaglib::_tagRef = NULL;
+    m_readPool.waitForDone();
+    if (m_tagRef) {
+        delete m_tagRef;
+        m_tagRef = NULL;
     }
 }
 
-QString NTagReaderTaglib::toUnicode(const TagLib::String &tstr) const
+QString NTagReaderTaglib::toUnicode(const TagLib::String &tstr, QTextCodec *codec) const
 {
     const char *cstr = tstr.toCString(false);
     QTextCodec::ConverterState state;
     m_utf8Codec->toUnicode(cstr, tstr.size(), &state);
     if (state.invalidChars == 0) {
         return m_utf8Codec->toUnicode(tstr.toCString(true));
+    } else if (codec) {
+        return codec->toUnicode(cstr);
     } else {
-        return m_codec->toUnicode(cstr);
+        return QString::fromLatin1(cstr);
     }
 }
 
@@ -114,33 +143,79 @@ QString NTagReaderTaglib::getTag(QChar ch) const
         return "";
     }
 
+    return readTag(m_tagRef, ch, m_codec);
+}
+
+NTagData NTagReaderTaglib::read(const QString &file, const QString &tags,
+                                const QString &encoding) const
+{
+    NTagData data;
+    data.file = file;
+
+    // not m_codec, which the GUI thread may be changing:
+    QTextCodec *codec = QTextCodec::codecForName(encoding.toUtf8());
+
+    TagLib::FileRef *tagRef = NULL;
+    if (QFileInfo(file).exists()) {
+        tagRef = NTaglib::open(file);
+    }
+    bool isValid = NTaglib::isValid(tagRef);
+    foreach (QChar ch, tags) {
+        data.tags[ch] = isValid ? readTag(tagRef, ch, codec) : "";
+    }
+    delete tagRef;
+
+    return data;
+}
+
+QList<NTagData> NTagReaderTaglib::readMany(const QStringList &files, const QString &tags,
+                                           const QString &encoding)
+{
+    QVector<NTagData> results(files.size());
+    QAtomicInt next(0);
+    QSemaphore done;
+
+    // workers take the next file as they go, no matter how the slow ones are spread:
+    int workers = qMin(files.size(), m_readPool.maxThreadCount());
+    for (int i = 0; i < workers; ++i) {
+        m_readPool.start(
+            new NTaglibReadWorker(this, files, tags, encoding, results.data(), next, done));
+    }
+    done.acquire(workers);
+
+    return results.toList();
+}
+
+QString NTagReaderTaglib::readTag(const TagLib::FileRef *tagRef, QChar ch,
+                                  QTextCodec *codec) const
+{
     switch (ch.unicode()) {
         case 'a': // artist
-            return toUnicode(NTaglib::_tagRef->tag()->artist());
+            return toUnicode(tagRef->tag()->artist(), codec);
         case 't': // title
-            return toUnicode(NTaglib::_tagRef->tag()->title());
+            return toUnicode(tagRef->tag()->title(), codec);
         case 'A': // album
-            return toUnicode(NTaglib::_tagRef->tag()->album());
+            return toUnicode(tagRef->tag()->album(), codec);
         case 'c': // comment
-            return toUnicode(NTaglib::_tagRef->tag()->comment());
+            return toUnicode(tagRef->tag()->comment(), codec);
         case 'g': // genre
-            return TStringToQString(NTaglib::_tagRef->tag()->genre());
+            return TStringToQString(tagRef->tag()->genre());
         case 'y': { // year
-            unsigned int res = NTaglib::_tagRef->tag()->year();
+            unsigned int res = tagRef->tag()->year();
             if (res == 0) {
                 return "";
             }
             return QString::number(res);
         }
         case 'n': { // track number
-            unsigned int res = NTaglib::_tagRef->tag()->track();
+            unsigned int res = tagRef->tag()->track();
             if (res == 0) {
                 return "";
             }
             return QString::number(res);
         }
         case 'b': { // bit depth
-            TagLib::AudioProperties *ap = NTaglib::_tagRef->audioProperties();
+            TagLib::AudioProperties *ap = tagRef->audioProperties();
             if (auto *prop = dynamic_cast<TagLib::APE::Properties *>(ap)) {
                 return QString::number(prop->bitsPerSample());
             } else if (auto *prop = dynamic_cast<TagLib::FLAC::Properties *>(ap)) {
@@ -160,35 +235,35 @@ QString NTagReaderTaglib::getTag(QChar ch) const
             }
         }
         case 'D': { // duration in seconds
-            int seconds = NTaglib::_tagRef->audioProperties()->length();
+            int seconds = tagRef->audioProperties()->length();
             if (seconds == 0) {
                 return "";
             }
             return QString::number(seconds);
         }
         case 'B': { // bitrate in Kbps
-            int res = NTaglib::_tagRef->audioProperties()->bitrate();
+            int res = tagRef->audioProperties()->bitrate();
             if (res == 0) {
                 return "";
             }
             return QString::number(res);
         }
         case 's': { // sample rate in kHz
-            int res = NTaglib::_tagRef->audioProperties()->sampleRate();
+            int res = tagRef->audioProperties()->sampleRate();
             if (res == 0) {
                 return "";
             }
             return QString::number(res / (float)1000);
         }
         case 'H': { // number of channels
-            int res = NTaglib::_tagRef->audioProperties()->channels();
+            int res = tagRef->audioProperties()->channels();
             if (res == 0) {
                 return "";
             }
             return QString::number(res);
         }
         case 'M': { // beats per minute
-            return TStringToQString(NTaglib::_tagRef->file()->properties()["BPM"].toString());
+            return TStringToQString(tagRef->file()->properties()["BPM"].toString());
         }
         default: // unsupported, convert to a tag and return
             return QString('%') + ch;
@@ -268,7 +343,7 @@ NTagReaderTaglib::TMapToQMap(const TagLib::Map<TagLib::String, TagLib::StringLis
         QStringList values;
         TagLib::StringList tlist = iter->second;
         for (auto iter = tlist.begin(); iter != tlist.end(); ++iter) {
-            values << toUnicode((*iter));
+            values << toUnicode((*iter), m_codec);
         }
         qmap[TStringToQString(iter->first)] = values;
     }
@@ -297,15 +372,15 @@ QMap<QString, QStringList> NTagReaderTaglib::getTags() const
         tags["Error"] = QStringList() << "Invalid";
         return tags;
     }
-    return TMapToQMap(NTaglib::_tagRef->file()->properties());
+    return TMapToQMap(m_tagRef->file()->properties());
 }
 
 QMap<QString, QStringList> NTagReaderTaglib::setTags(const QMap<QString, QStringList> &tags)
 {
     QMap<QString, QStringList> unsaved = TMapToQMap(
-        NTaglib::_tagRef->file()->setProperties(QMapToTMap(tags)));
+        m_tagRef->file()->setProperties(QMapToTMap(tags)));
     if (unsaved.isEmpty()) {
-        bool success = NTaglib::_tagRef->file()->save();
+        bool success = m_tagRef->file()->save();
         if (!success) { // workaround to relay the error
             unsaved["Error"] = QStringList() << "Write";
         }
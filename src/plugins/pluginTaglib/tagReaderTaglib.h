@@ -23,6 +23,8 @@
 #include <tag.h>
 #include <tmap.h>
 
+#include <QThreadPool>
+
 class QString;
 
 class NTagReaderTaglib : public NTagReaderInterface, public NPlugin
@@ -31,9 +33,14 @@ class NTagReaderTaglib : public NTagReaderInterface, public NPlugin
     Q_INTERFACES(NTagReaderInterface NPlugin)
 
 private:
+    TagLib::FileRef *m_tagRef;
+    QString m_filePath;
     bool m_isValid;
     QTextCodec *m_codec;
     QTextCodec *m_utf8Codec;
+    QThreadPool m_readPool;
+
+    QString readTag(const TagLib::FileRef *tagRef, QChar ch, QTextCodec *codec) const;
 
 public:
     NTagReaderTaglib(QObject *parent = 0);
@@ -46,10 +53,15 @@ public:
     void setSource(const QString &file);
     void setEncoding(const QString &encoding);
     QString getTag(QChar ch) const;
+    QList<NTagData> readMany(const QStringList &files, const QString &tags,
+                             const QString &encoding);
+    bool isReadManyThreadSafe() const { return true; }
+    NTagData read(const QString &file, const QString &tags,
+                  const QString &encoding) const; // from any thread
     N::Tag tagFromKey(const QString &key) const;
     QString tagToKey(N::Tag tag) const;
 
-    QString toUnicode(const TagLib::String &tstr) const;
+    QString toUnicode(const TagLib::String &tstr, QTextCodec *codec) const;
 
     bool isWriteSupported() const { return true; }
     QMap<QString, QStringList> getTags() const;
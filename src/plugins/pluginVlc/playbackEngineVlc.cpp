@@ -19,12 +19,17 @@
 
 #include "common.h"
 
+static const libvlc_event_type_t _events[] = {
+    libvlc_MediaPlayerPositionChanged, libvlc_MediaPlayerTimeChanged,
+    libvlc_MediaPlayerOpening,         libvlc_MediaPlayerPlaying,
+    libvlc_MediaPlayerPaused,          libvlc_MediaPlayerStopped,
+    libvlc_MediaPlayerEndReached,      libvlc_MediaPlayerEncounteredError,
+    libvlc_MediaPlayerAudioVolume};
+
 static void _eventHandler(const libvlc_event_t *event, void *userData)
 {
-    if (event->type == libvlc_MediaPlayerEndReached) {
-        NPlaybackEngineVlc *obj = reinterpret_cast<NPlaybackEngineVlc *>(userData);
-        obj->_emitFinished();
-    }
+    NPlaybackEngineVlc *obj = reinterpret_cast<NPlaybackEngineVlc *>(userData);
+    obj->_postEvent(event->type);
 }
 
 static N::PlaybackState fromVlcState(libvlc_state_t state)
@@ -59,17 +64,16 @@ void NPlaybackEngineVlc::init()
     m_vlcInstance = libvlc_new(argVector.size(), &argVector[0]);
     m_vlcMediaPlayer = libvlc_media_player_new(m_vlcInstance);
     m_vlcEventManager = libvlc_media_player_event_manager(m_vlcMediaPlayer);
-    libvlc_event_attach(m_vlcEventManager, libvlc_MediaPlayerEndReached, _eventHandler, this);
+    for (size_t i = 0; i < sizeof(_events) / sizeof(_events[0]); ++i) {
+        libvlc_event_attach(m_vlcEventManager, _events[i], _eventHandler, this);
+    }
 
     m_volume = -1;
     m_position = -1;
     m_vlcState = libvlc_NothingSpecial;
     m_currentMedia = "";
     m_currentContext = 0;
-
-    m_timer = new QTimer(this);
-    connect(m_timer, SIGNAL(timeout()), this, SLOT(checkStatus()));
-    m_timer->start(100);
+    m_pendingEvents.storeRelease(0);
 
     m_init = true;
 }
@@ -81,6 +85,9 @@ NPlaybackEngineVlc::~NPlaybackEngineVlc()
     }
 
     stop();
+    for (size_t i = 0; i < sizeof(_events) / sizeof(_events[0]); ++i) {
+        libvlc_event_detach(m_vlcEventManager, _events[i], _eventHandler, this);
+    }
     libvlc_media_player_release(m_vlcMediaPlayer);
     libvlc_release(m_vlcInstance);
 }
@@ -88,6 +95,8 @@ NPlaybackEngineVlc::~NPlaybackEngineVlc()
 void NPlaybackEngineVlc::setMedia(const QString &file, int context)
 {
     stop();
+    // the old media has ended or failed for good, not the new one:
+    m_pendingEvents.fetchAndAndOrdered(~(FinishedEvent | ErrorEvent));
 
     if (file.isEmpty()) {
         return;
@@ -212,30 +221,71 @@ N::PlaybackState NPlaybackEngineVlc::state() const
     return fromVlcState(m_vlcState);
 }
 
-void NPlaybackEngineVlc::checkStatus()
+void NPlaybackEngineVlc::_postEvent(int type)
 {
-    qreal pos = position();
-    if (m_position != pos) {
-        m_position = pos;
-        emit positionChanged(pos);
+    int event;
+    switch (type) {
+        case libvlc_MediaPlayerPositionChanged:
+            event = PositionEvent;
+            break;
+        case libvlc_MediaPlayerTimeChanged:
+            event = TimeEvent;
+            break;
+        case libvlc_MediaPlayerAudioVolume:
+            event = VolumeEvent;
+            break;
+        case libvlc_MediaPlayerEndReached:
+            event = FinishedEvent | StateEvent;
+            break;
+        case libvlc_MediaPlayerEncounteredError:
+            event = ErrorEvent | StateEvent;
+            break;
+        default:
+            event = StateEvent;
+            break;
     }
 
-    qreal vol = volume();
-    if (m_volume != vol) {
-        m_volume = vol;
-        emit volumeChanged(vol);
+    // from a VLC thread, only the first event since the last processing wakes the GUI thread:
+    if (m_pendingEvents.fetchAndOrOrdered(event) == 0) {
+        QMetaObject::invokeMethod(this, "processEvents", Qt::QueuedConnection);
     }
+}
 
-    libvlc_state_t vlcState = libvlc_media_player_get_state(m_vlcMediaPlayer);
-    if (m_vlcState != vlcState) {
-        m_vlcState = vlcState;
-        emit stateChanged(fromVlcState(m_vlcState));
+void NPlaybackEngineVlc::processEvents()
+{
+    int events = m_pendingEvents.fetchAndStoreOrdered(0);
+
+    if (events & StateEvent) {
+        libvlc_state_t vlcState = libvlc_media_player_get_state(m_vlcMediaPlayer);
+        if (m_vlcState != vlcState) {
+            m_vlcState = vlcState;
+            emit stateChanged(fromVlcState(m_vlcState));
+        }
     }
 
-    emit tick(libvlc_media_player_get_time(m_vlcMediaPlayer));
-}
+    if (events & PositionEvent) {
+        qreal pos = position();
+        if (m_position != pos) {
+            m_position = pos;
+            emit positionChanged(pos);
+        }
+    }
 
-void NPlaybackEngineVlc::_emitFinished()
-{
-    emit mediaFinished(m_currentMedia, m_currentContext);
+    if (events & TimeEvent) {
+        emit tick(libvlc_media_player_get_time(m_vlcMediaPlayer));
+    }
+
+    if (events & VolumeEvent) {
+        qreal vol = volume();
+        if (m_volume != vol) {
+            m_volume = vol;
+            emit volumeChanged(vol);
+        }
+    }
+
+    if (events & ErrorEvent) {
+        emit mediaFailed(m_currentMedia, m_currentContext);
+    } else if (events & FinishedEvent) {
+        emit mediaFinished(m_currentMedia, m_currentContext);
+    }
 }
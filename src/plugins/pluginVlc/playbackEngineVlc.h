@@ -20,7 +20,7 @@
 #include <vlc_aout.h>
 #undef msleep
 
-#include <QTimer>
+#include <QAtomicInt>
 
 #include "playbackEngineInterface.h"
 #include "plugin.h"
@@ -31,11 +31,21 @@ class NPlaybackEngineVlc : public NPlaybackEngineInterface, public NPlugin
     Q_INTERFACES(NPlaybackEngineInterface NPlugin)
 
 private:
+    enum PendingEvent
+    {
+        PositionEvent = 0x01,
+        TimeEvent = 0x02,
+        StateEvent = 0x04,
+        VolumeEvent = 0x08,
+        FinishedEvent = 0x10,
+        ErrorEvent = 0x20
+    };
+
     libvlc_instance_t *m_vlcInstance;
     libvlc_media_player_t *m_vlcMediaPlayer;
     libvlc_event_manager_t *m_vlcEventManager;
 
-    QTimer *m_timer;
+    QAtomicInt m_pendingEvents; // posted by the VLC threads, handled at once on the GUI thread
     qreal m_volume;
     qreal m_position;
     libvlc_state_t m_vlcState;
@@ -67,10 +77,10 @@ public slots:
     Q_INVOKABLE void stop();
     Q_INVOKABLE void pause();
 
-    void _emitFinished();
+    void _postEvent(int type);
 
 private slots:
-    void checkStatus();
+    void processEvents();
 
 signals:
     void positionChanged(qreal pos);
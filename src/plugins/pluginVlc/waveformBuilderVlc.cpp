@@ -18,11 +18,36 @@
 #include <QDebug>
 #include <QFile>
 #include <QMutex>
+#include <QSemaphore>
 
 #include "common.h"
 
 static QMutex _mutex;
 
+struct NVlcPrecomputeJob
+{
+    QByteArray pcmBuffer;
+    NWaveformPeaks peaks;
+    QSemaphore finished;
+    bool completed;
+};
+
+// smem with no-time-sync hands the samples over as fast as they are decoded, libvlc audio
+// callbacks are an audio output and are paced by the input clock.
+static QByteArray _smemOptions(void *prepareBuffer, void *handleBuffer, void *userData)
+{
+    char smem_options[512];
+    sprintf(smem_options,
+            "#transcode{acodec=s16l}:smem{"
+            "audio-prerender-callback=%lld,"
+            "audio-postrender-callback=%lld,"
+            "audio-data=%lld,"
+            "no-time-sync}",
+            (long long int)(intptr_t)prepareBuffer, (long long int)(intptr_t)handleBuffer,
+            (long long int)(intptr_t)userData);
+    return QByteArray(smem_options);
+}
+
 static void _prepareBuffer(void *userData, uint8_t **pcmBuffer, unsigned int size)
 {
     QMutexLocker locker(&_mutex);
@@ -46,12 +71,43 @@ static void _handleBuffer(void *userData, uint8_t *pcmBuffer, unsigned int nChan
     obj->handleBuffer(pcmBuffer, nChannels, nSamples);
 }
 
-void NWaveformBuilderVlc::prepareBuffer(uint8_t **pcmBuffer, unsigned int size)
+static void _precomputePrepareBuffer(void *userData, uint8_t **pcmBuffer, unsigned int size)
 {
-    if (!m_timer->isActive()) {
-        m_timer->start(300);
+    NVlcPrecomputeJob *job = reinterpret_cast<NVlcPrecomputeJob *>(userData);
+    if (job->pcmBuffer.size() < (int)size) {
+        job->pcmBuffer.resize(size);
     }
+    *pcmBuffer = (uint8_t *)(job->pcmBuffer.data());
+}
+
+static void _precomputeHandleBuffer(void *userData, uint8_t *pcmBuffer, unsigned int nChannels,
+                                    unsigned int frequency, unsigned int nSamples,
+                                    unsigned int bitsPerSample, unsigned int size, int64_t pts)
+{
+    Q_UNUSED(pts);
+    Q_UNUSED(frequency);
+    Q_UNUSED(bitsPerSample);
+    Q_UNUSED(size);
 
+    NVlcPrecomputeJob *job = reinterpret_cast<NVlcPrecomputeJob *>(userData);
+    job->peaks.appendBlock(reinterpret_cast<const qint16 *>(pcmBuffer), nChannels, nSamples);
+}
+
+static void _finished(const libvlc_event_t *event, void *userData)
+{
+    NWaveformBuilderVlc *obj = reinterpret_cast<NWaveformBuilderVlc *>(userData);
+    obj->_emitFinished(event->type == libvlc_MediaPlayerEndReached);
+}
+
+static void _precomputeFinished(const libvlc_event_t *event, void *userData)
+{
+    NVlcPrecomputeJob *job = reinterpret_cast<NVlcPrecomputeJob *>(userData);
+    job->completed = (event->type == libvlc_MediaPlayerEndReached);
+    job->finished.release();
+}
+
+void NWaveformBuilderVlc::prepareBuffer(uint8_t **pcmBuffer, unsigned int size)
+{
     if (m_pcmBuffer.size() < (int)size) {
         m_pcmBuffer.resize(size);
     }
@@ -62,32 +118,26 @@ void NWaveformBuilderVlc::prepareBuffer(uint8_t **pcmBuffer, unsigned int size)
 void NWaveformBuilderVlc::handleBuffer(uint8_t *pcmBuffer, unsigned int nChannels,
                                        unsigned int nSamples)
 {
-    for (unsigned int i = 0; i < nSamples; ++i) {
-        qint32 pcmValue = 0;
-        for (unsigned int j = 0; j < nChannels; ++j) {
-            const qint16 *ptr = reinterpret_cast<const qint16 *>(pcmBuffer) + i * nChannels + j;
-            pcmValue += *ptr;
-        }
-        qreal realValue = -((qreal)pcmValue / nChannels) / (1 << 15);
-        m_peaks.append(realValue);
+    m_peaks.appendBlock(reinterpret_cast<const qint16 *>(pcmBuffer), nChannels, nSamples);
+    if (peaksPublish()) {
+        QMetaObject::invokeMethod(this, "peaksAdvanced", Qt::QueuedConnection);
     }
 }
 
+void NWaveformBuilderVlc::_emitFinished(bool completed)
+{
+    // from a VLC thread, which must not call back into its own media player:
+    QMetaObject::invokeMethod(this, "finish", Qt::QueuedConnection,
+                              Q_ARG(int, m_generation.loadAcquire()), Q_ARG(bool, completed));
+}
+
 void NWaveformBuilderVlc::init()
 {
     if (m_init) {
         return;
     }
 
-    char smem_options[512];
-    sprintf(smem_options,
-            "#transcode{acodec=s16l}:smem{"
-            "audio-prerender-callback=%lld,"
-            "audio-postrender-callback=%lld,"
-            "audio-data=%lld,"
-            "no-time-sync}",
-            (long long int)(intptr_t)(void *)&_prepareBuffer,
-            (long long int)(intptr_t)(void *)&_handleBuffer, (long long int)(intptr_t)(void *)this);
+    QByteArray smemOptions = _smemOptions((void *)&_prepareBuffer, (void *)&_handleBuffer, this);
 
     int argc;
     const char **argv;
@@ -101,13 +151,15 @@ void NWaveformBuilderVlc::init()
               << "dummy"
               << "--ignore-config"
               << "--no-xlib"
-              << "--sout" << smem_options;
+              << "--no-video"
+              << "--sout" << smemOptions.constData();
 
     m_vlcInstance = libvlc_new(argVector.size(), &argVector[0]);
     m_mediaPlayer = libvlc_media_player_new(m_vlcInstance);
 
-    m_timer = new QTimer(this);
-    connect(m_timer, SIGNAL(timeout()), this, SLOT(update()));
+    libvlc_event_manager_t *eventManager = libvlc_media_player_event_manager(m_mediaPlayer);
+    libvlc_event_attach(eventManager, libvlc_MediaPlayerEndReached, _finished, this);
+    libvlc_event_attach(eventManager, libvlc_MediaPlayerEncounteredError, _finished, this);
 
     reset();
 
@@ -116,20 +168,26 @@ void NWaveformBuilderVlc::init()
 
 NWaveformBuilderVlc::~NWaveformBuilderVlc()
 {
+    precomputeStop();
+
     if (!m_init) {
         return;
     }
 
     stop();
 
+    libvlc_event_manager_t *eventManager = libvlc_media_player_event_manager(m_mediaPlayer);
+    libvlc_event_detach(eventManager, libvlc_MediaPlayerEndReached, _finished, this);
+    libvlc_event_detach(eventManager, libvlc_MediaPlayerEncounteredError, _finished, this);
     libvlc_media_player_release(m_mediaPlayer);
     libvlc_release(m_vlcInstance);
 }
 
 void NWaveformBuilderVlc::stop()
 {
-    m_timer->stop();
+    // joins the decoding threads, whatever they have posted since is stale:
     libvlc_media_player_stop(m_mediaPlayer);
+    m_generation.fetchAndAddOrdered(1);
 
     libvlc_media_t *media = libvlc_media_player_get_media(m_mediaPlayer);
     if (media)
@@ -146,6 +204,7 @@ void NWaveformBuilderVlc::start(const QString &file)
     stop();
 
     if (peaksFindFromCache(file)) {
+        emit peaksCompleted();
         return;
     }
     if (!QFileInfo(file).exists()) {
@@ -153,31 +212,78 @@ void NWaveformBuilderVlc::start(const QString &file)
     }
     m_currentFile = file;
 
-    libvlc_media_t *media = libvlc_media_player_get_media(m_mediaPlayer);
-    if (media) {
-        libvlc_media_player_stop(m_mediaPlayer);
-        libvlc_media_release(media);
-    }
-
     libvlc_media_t *mediaDescriptor = libvlc_media_new_path(m_vlcInstance, file.toUtf8());
     libvlc_media_player_set_media(m_mediaPlayer, mediaDescriptor);
+    libvlc_media_release(mediaDescriptor);
 
     reset();
     QThread::start();
     libvlc_media_player_play(m_mediaPlayer);
 }
 
-void NWaveformBuilderVlc::update()
+void NWaveformBuilderVlc::finish(int generation, bool completed)
 {
-    if (!libvlc_media_player_is_playing(m_mediaPlayer)) {
-        m_peaks.complete();
+    if (generation != m_generation.loadAcquire()) {
+        return;
+    }
+
+    // stopping joins the decoding threads, m_peaks is ours afterwards:
+    stop();
+    if (!completed) {
+        qWarning() << "WaveformBuilder :: error ::" << m_currentFile;
+        return;
+    }
+
+    peaksComplete();
 #if defined(QT_DEBUG) && !defined(QT_NO_DEBUG)
-        qDebug() << "WaveformBuilder ::"
-                 << "completed" << m_peaks.size();
+    qDebug() << "WaveformBuilder ::"
+             << "completed" << m_peaks.size();
 #endif
-        peaksAppendToCache(m_currentFile);
-        stop();
+    peaksAppendToCache(m_currentFile);
+    emit peaksCompleted();
+}
+
+bool NWaveformBuilderVlc::decode(const QString &file, NWaveformPeaks &peaks)
+{
+    if (!m_init) {
+        return false;
+    }
+
+    NVlcPrecomputeJob job;
+    job.completed = false;
+
+    // per-media stream output, so that every job gets its own callbacks data:
+    QByteArray smemOptions = ":sout=" + _smemOptions((void *)&_precomputePrepareBuffer,
+                                                     (void *)&_precomputeHandleBuffer, &job);
+
+    libvlc_media_t *media = libvlc_media_new_path(m_vlcInstance, file.toUtf8());
+    libvlc_media_add_option(media, smemOptions.constData());
+    libvlc_media_player_t *mediaPlayer = libvlc_media_player_new_from_media(media);
+    libvlc_media_release(media);
+
+    libvlc_event_manager_t *eventManager = libvlc_media_player_event_manager(mediaPlayer);
+    libvlc_event_attach(eventManager, libvlc_MediaPlayerEndReached, _precomputeFinished, &job);
+    libvlc_event_attach(eventManager, libvlc_MediaPlayerEncounteredError, _precomputeFinished,
+                        &job);
+
+    libvlc_media_player_play(mediaPlayer);
+    while (!job.finished.tryAcquire(1, 100)) {
+        if (precomputeCancelled()) {
+            break;
+        }
+    }
+
+    libvlc_event_detach(eventManager, libvlc_MediaPlayerEndReached, _precomputeFinished, &job);
+    libvlc_event_detach(eventManager, libvlc_MediaPlayerEncounteredError, _precomputeFinished,
+                        &job);
+    libvlc_media_player_stop(mediaPlayer);
+    libvlc_media_player_release(mediaPlayer);
+
+    if (job.completed) {
+        job.peaks.complete();
+        peaks = job.peaks;
     }
+    return job.completed;
 }
 
 qreal NWaveformBuilderVlc::position() const
@@ -18,7 +18,7 @@
 
 #include <vlc/vlc.h>
 
-#include <QTimer>
+#include <QAtomicInt>
 
 #include "abstractWaveformBuilder.h"
 #include "plugin.h"
@@ -35,10 +35,11 @@ private:
     libvlc_instance_t *m_vlcInstance;
     libvlc_media_player_t *m_mediaPlayer;
     QString m_currentFile;
+    QAtomicInt m_generation; // of the media being decoded, events of the older ones are dropped
 
     QByteArray m_pcmBuffer;
-    QTimer *m_timer;
     qreal position() const;
+    bool decode(const QString &file, NWaveformPeaks &peaks);
 
 public:
     NWaveformBuilderVlc(QObject *parent = NULL) : NWaveformBuilderInterface(parent) {}
@@ -54,12 +55,26 @@ public:
         NAbstractWaveformBuilder::positionAndIndex(pos, index);
     }
     const NWaveformPeaks &peaks() const { return NAbstractWaveformBuilder::peaks(); }
+    void precompute(const QStringList &files) { NAbstractWaveformBuilder::precompute(files); }
+    void setPrecomputeJobs(int jobs) { NAbstractWaveformBuilder::setPrecomputeJobs(jobs); }
+    void precomputeWait() { NAbstractWaveformBuilder::precomputeWait(); }
+    void setCacheBudget(qint64 memoryBytes, qint64 diskBytes)
+    {
+        NAbstractWaveformBuilder::setCacheBudget(memoryBytes, diskBytes);
+    }
+    NWaveformCacheStats cacheStats() const { return NAbstractWaveformBuilder::cacheStats(); }
+    void setSharedDecode(bool) {} // libvlc offers no way to tap the playback output
 
     void prepareBuffer(uint8_t **pcmBuffer, unsigned int size);
     void handleBuffer(uint8_t *pcmBuffer, unsigned int nChannels, unsigned int nSamples);
+    void _emitFinished(bool completed);
 
 private slots:
-    void update();
+    void finish(int generation, bool completed);
+
+signals:
+    void peaksAdvanced();
+    void peaksCompleted();
 };
 
 #endif
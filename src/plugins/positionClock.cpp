@@ -0,0 +1,100 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#include "positionClock.h"
+
+#include <QtGlobal>
+
+#define SLEW_NSEC 1000000000LL // 1 second
+#define SNAP_NSEC 250000000LL  // 250 milliseconds
+
+NPositionClock::NPositionClock()
+{
+    m_clock.start();
+    m_rate = 0.0;
+    reset();
+}
+
+qint64 NPositionClock::now() const
+{
+    return m_clock.nsecsElapsed();
+}
+
+void NPositionClock::reset()
+{
+    m_valid = false;
+    m_baseNsec = 0;
+    m_baseTimeNsec = 0;
+    m_errorNsec = 0;
+}
+
+qint64 NPositionClock::slewed(qint64 dt) const
+{
+    if (dt >= SLEW_NSEC) {
+        return m_errorNsec;
+    }
+    return m_errorNsec * dt / SLEW_NSEC;
+}
+
+qint64 NPositionClock::position(qint64 nowNsec) const
+{
+    if (!m_valid) {
+        return 0;
+    }
+    qint64 dt = qMax((qint64)0, nowNsec - m_baseTimeNsec);
+    return m_baseNsec + (qint64)(dt * m_rate) + slewed(dt);
+}
+
+void NPositionClock::sample(qint64 positionNsec, qint64 nowNsec)
+{
+    if (!m_valid) {
+        m_valid = true;
+        m_baseNsec = positionNsec;
+        m_baseTimeNsec = nowNsec;
+        m_errorNsec = 0;
+        return;
+    }
+
+    qint64 predicted = position(nowNsec);
+    qint64 error = positionNsec - predicted;
+    m_baseTimeNsec = nowNsec;
+
+    // slewing at no less than half the rate keeps the position going forward:
+    if (m_rate == 0.0 || qAbs(error) > SNAP_NSEC ||
+        error < -(qint64)(m_rate * SLEW_NSEC / 2)) {
+        m_baseNsec = positionNsec;
+        m_errorNsec = 0;
+    } else {
+        m_baseNsec = predicted;
+        m_errorNsec = error;
+    }
+}
+
+void NPositionClock::setRate(qreal rate, qint64 nowNsec)
+{
+    if (m_valid) {
+        qint64 dt = qMax((qint64)0, nowNsec - m_baseTimeNsec);
+        qint64 remaining = m_errorNsec - slewed(dt);
+        m_baseNsec = position(nowNsec);
+        m_baseTimeNsec = nowNsec;
+        m_errorNsec = remaining;
+        // applied at once while paused, or if slewing it would run backwards:
+        if (rate == 0.0 || remaining < -(qint64)(rate * SLEW_NSEC / 2)) {
+            m_baseNsec += remaining;
+            m_errorNsec = 0;
+        }
+    }
+    m_rate = rate;
+}
@@ -0,0 +1,48 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#ifndef N_POSITION_CLOCK_H
+#define N_POSITION_CLOCK_H
+
+#include <QElapsedTimer>
+
+// Playback position between the pipeline queries: extrapolated from the last
+// sample with the monotonic clock and the playback rate. Small differences from
+// a new sample are slewed in over a while, so the position never goes backwards
+// while playing; seeks and stalls are taken as they are.
+class NPositionClock
+{
+private:
+    QElapsedTimer m_clock;
+    bool m_valid;
+    qint64 m_baseNsec;     // position at m_baseTimeNsec
+    qint64 m_baseTimeNsec; // monotonic
+    qint64 m_errorNsec;    // being slewed in since m_baseTimeNsec
+    qreal m_rate;          // 0 while not playing
+
+    qint64 slewed(qint64 dt) const;
+
+public:
+    NPositionClock();
+
+    qint64 now() const; // monotonic nanoseconds
+    void reset(); // forgets the position, keeps the rate
+    bool isValid() const { return m_valid; }
+    void sample(qint64 positionNsec, qint64 nowNsec);
+    void setRate(qreal rate, qint64 nowNsec);
+    qint64 position(qint64 nowNsec) const;
+};
+
+#endif
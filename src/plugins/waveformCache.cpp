@@ -0,0 +1,572 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#include "waveformCache.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QMap>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSet>
+
+#define CACHE_MAGIC 0x4E504B53 // "NPKS"
+#define CACHE_VERSION 4
+#define HEADER_SIZE 8
+#define RECORD_MAGIC 0x4E524543 // "NREC"
+#define COMPACT_MIN_BYTES (1024 * 1024)
+#define EVICT_TO_PERCENT 90
+
+class NWaveformCacheCompaction : public QRunnable
+{
+private:
+    NWaveformCache *m_cache;
+
+public:
+    NWaveformCacheCompaction(NWaveformCache *cache) : m_cache(cache) {}
+    void run() { m_cache->compact(); }
+};
+
+NWaveformCache::NWaveformCache(const QString &fileName) : m_lock(fileName + ".lock")
+{
+    m_fileName = fileName;
+    m_opened = false;
+    m_writable = false;
+    m_liveBytes = 0;
+    m_maxSize = 0;
+    m_clock = 0;
+    m_evictions = 0;
+    m_compacting = false;
+    m_pool.setMaxThreadCount(1);
+}
+
+NWaveformCache::~NWaveformCache()
+{
+    m_pool.waitForDone();
+    m_file.close();
+}
+
+void NWaveformCache::open()
+{
+    if (m_opened) {
+        return;
+    }
+    m_opened = true;
+
+    // held for as long as the cache is open, released by the system if the process dies:
+    m_lock.setStaleLockTime(0);
+    m_writable = m_lock.tryLock(0);
+    if (!m_writable) {
+        qWarning() << "WaveformBuilder :: cache is in use by another process, not writing"
+                   << m_fileName;
+    }
+
+    m_file.setFileName(m_fileName);
+    if (!m_file.open(m_writable ? QIODevice::ReadWrite : QIODevice::ReadOnly)) {
+        qWarning() << "WaveformBuilder :: error :: cannot open cache" << m_fileName;
+        return;
+    }
+
+    QDataStream inFile(&m_file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    if (m_file.size() > 0) {
+        inFile >> magic;
+        if (magic == CACHE_MAGIC) {
+            inFile >> version;
+        }
+    }
+
+    if (m_file.size() == 0 || (magic == CACHE_MAGIC && version == CACHE_VERSION)) {
+        if (!scan()) {
+            m_file.close();
+        }
+        return;
+    }
+
+    if (magic == CACHE_MAGIC && version > CACHE_VERSION) {
+        qWarning() << "WaveformBuilder :: unsupported cache version" << version;
+        m_file.close();
+        return;
+    }
+
+    if (!m_writable) {
+        m_file.close();
+        return;
+    }
+
+    migrate(magic == CACHE_MAGIC ? version : 0);
+}
+
+void NWaveformCache::addToIndex(RecordType type, const QByteArray &key, Entry entry)
+{
+    entry.access = ++m_clock;
+    QByteArray indexKey = QByteArray(1, (char)type) + key;
+    if (m_index.contains(indexKey)) {
+        m_liveBytes -= m_index.value(indexKey).size;
+    }
+    m_index.insert(indexKey, entry);
+    m_liveBytes += entry.size;
+}
+
+bool NWaveformCache::scan()
+{
+    m_index.clear();
+    m_liveBytes = 0;
+
+    qint64 fileSize = m_file.size();
+    if (fileSize < HEADER_SIZE) {
+        if (!m_writable) {
+            return true;
+        }
+        m_file.resize(0);
+        m_file.seek(0);
+        QDataStream outFile(&m_file);
+        outFile << (quint32)CACHE_MAGIC << (quint32)CACHE_VERSION;
+        return m_file.flush();
+    }
+
+    // only the record headers are read, peaks payloads are skipped:
+    QDataStream inFile(&m_file);
+    qint64 offset = HEADER_SIZE;
+    m_file.seek(offset);
+    while (offset < fileSize) {
+        quint32 magic;
+        quint8 type;
+        QByteArray key;
+        QString date;
+        quint32 payloadSize;
+        inFile >> magic;
+        if (magic != RECORD_MAGIC) {
+            break;
+        }
+        inFile >> type >> key >> date >> payloadSize;
+        qint64 end = m_file.pos() + payloadSize;
+        if (inFile.status() != QDataStream::Ok || end > fileSize) {
+            break;
+        }
+
+        Entry entry = {date, offset, end - offset, 0, QByteArray(), 0};
+        if (type == PathRecord) {
+            QByteArray payload = m_file.read(payloadSize);
+            QDataStream inPayload(&payload, QIODevice::ReadOnly);
+            inPayload >> entry.fileSize >> entry.fingerprint;
+        }
+        m_file.seek(end);
+
+        addToIndex((RecordType)type, key, entry);
+        offset = end;
+    }
+
+    // path keyed peaks left behind by a migration that was not followed by a compaction:
+    for (QHash<QByteArray, Entry>::iterator it = m_index.begin(); it != m_index.end();) {
+        if (it.key().at(0) == (char)PeaksRecord &&
+            m_index.contains(QByteArray(1, (char)PathRecord) + it.key().mid(1))) {
+            m_liveBytes -= it.value().size;
+            it = m_index.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // with no lock, the writing process may be in the middle of this record:
+    if (offset < fileSize && m_writable) { // interrupted write
+        qWarning() << "WaveformBuilder :: truncating damaged cache at" << offset;
+        m_file.resize(offset);
+    }
+
+    return true;
+}
+
+void NWaveformCache::migrate(quint32 version)
+{
+    QList<QByteArray> hashes;
+    QList<QString> dates;
+    QList<QByteArray> payloads;
+
+    if (version == 3) { // path keyed records only
+        QDataStream inFile(&m_file);
+        m_file.seek(HEADER_SIZE);
+        forever {
+            quint32 magic;
+            QByteArray key;
+            QString date;
+            QByteArray payload;
+            inFile >> magic;
+            if (magic != RECORD_MAGIC) {
+                break;
+            }
+            inFile >> key >> date >> payload;
+            if (inFile.status() != QDataStream::Ok) {
+                break;
+            }
+            hashes << key;
+            dates << date;
+            payloads << payload;
+        }
+    } else {
+        m_file.seek(version == 0 ? 0 : HEADER_SIZE);
+        QDataStream inFile(&m_file);
+        QByteArray compressed;
+        inFile >> compressed;
+
+        QByteArray buffer = qUncompress(compressed);
+        QDataStream inBuffer(&buffer, QIODevice::ReadOnly);
+
+        QList<NWaveformPeaks> peaks;
+        QHash<QByteArray, QString> dateHash;
+        if (version == 0) { // single resolution peaks
+            quint32 count;
+            inBuffer >> hashes >> count;
+            for (quint32 i = 0; i < count && !inBuffer.atEnd(); ++i) {
+                QVector<QPair<qreal, qreal>> bins;
+                int index;
+                bool completed;
+                inBuffer >> bins >> index >> completed;
+                peaks << NWaveformPeaks::fromBins(bins);
+            }
+        } else if (version == 1) { // unquantized pyramid
+            quint32 count;
+            inBuffer >> hashes >> count;
+            for (quint32 i = 0; i < count && !inBuffer.atEnd(); ++i) {
+                QVector<QVector<QPair<qreal, qreal>>> levels;
+                bool completed;
+                inBuffer >> levels >> completed;
+                peaks << NWaveformPeaks::fromBins(levels.value(0));
+            }
+        } else {
+            inBuffer >> hashes >> peaks;
+        }
+        inBuffer >> dateHash;
+
+        hashes = hashes.mid(0, peaks.count());
+        for (int i = 0; i < hashes.count(); ++i) {
+            QByteArray record;
+            QDataStream outRecord(&record, QIODevice::WriteOnly);
+            outRecord << peaks.at(i);
+            dates << dateHash.value(hashes.at(i));
+            payloads << qCompress(record);
+        }
+    }
+
+    // path keyed peaks are kept as they are, the builder moves them to their content keys
+    // on first access and removes them:
+    m_index.clear();
+    m_liveBytes = 0;
+    m_file.resize(0);
+    m_file.seek(0);
+    QDataStream outFile(&m_file);
+    outFile << (quint32)CACHE_MAGIC << (quint32)CACHE_VERSION;
+
+    for (int i = 0; i < hashes.count(); ++i) {
+        if (dates.at(i).isEmpty()) {
+            continue;
+        }
+        Entry entry;
+        if (append(m_file, PeaksRecord, hashes.at(i), dates.at(i), payloads.at(i), entry)) {
+            addToIndex(PeaksRecord, hashes.at(i), entry);
+        }
+    }
+    m_file.flush();
+}
+
+bool NWaveformCache::append(QFile &file, RecordType type, const QByteArray &key,
+                            const QString &date, const QByteArray &payload, Entry &entry)
+{
+    entry.offset = file.size();
+    file.seek(entry.offset);
+    QDataStream outFile(&file);
+    outFile << (quint32)RECORD_MAGIC << (quint8)type << key << date << payload;
+    entry.date = date;
+    entry.size = file.pos() - entry.offset;
+    entry.fileSize = 0;
+    return outFile.status() == QDataStream::Ok;
+}
+
+bool NWaveformCache::contains(const QByteArray &key)
+{
+    QMutexLocker locker(&m_mutex);
+    open();
+    return m_index.contains(QByteArray(1, (char)PeaksRecord) + key);
+}
+
+QString NWaveformCache::date(const QByteArray &key)
+{
+    QMutexLocker locker(&m_mutex);
+    open();
+    return m_index.value(QByteArray(1, (char)PeaksRecord) + key).date;
+}
+
+bool NWaveformCache::read(const QByteArray &key, NWaveformPeaks &peaks)
+{
+    QByteArray payload;
+    {
+        QMutexLocker locker(&m_mutex);
+        open();
+        QByteArray indexKey = QByteArray(1, (char)PeaksRecord) + key;
+        if (!m_file.isOpen() || !m_index.contains(indexKey)) {
+            return false;
+        }
+
+        m_index[indexKey].access = ++m_clock;
+        m_file.seek(m_index.value(indexKey).offset);
+        QDataStream inFile(&m_file);
+        quint32 magic;
+        quint8 type;
+        QByteArray recordKey;
+        QString date;
+        inFile >> magic >> type >> recordKey >> date >> payload;
+        if (inFile.status() != QDataStream::Ok || magic != RECORD_MAGIC ||
+            type != PeaksRecord || recordKey != key) {
+            qWarning() << "WaveformBuilder :: error :: damaged cache record";
+            return false;
+        }
+    }
+
+    QByteArray buffer = qUncompress(payload);
+    QDataStream inBuffer(&buffer, QIODevice::ReadOnly);
+    inBuffer >> peaks;
+    return inBuffer.status() == QDataStream::Ok;
+}
+
+void NWaveformCache::insert(const QByteArray &key, const QString &date,
+                            const NWaveformPeaks &peaks)
+{
+    QByteArray buffer;
+    QDataStream outBuffer(&buffer, QIODevice::WriteOnly);
+    outBuffer << peaks;
+    QByteArray payload = qCompress(buffer);
+
+    QMutexLocker locker(&m_mutex);
+    open();
+    if (!m_file.isOpen() || !m_writable) {
+        return;
+    }
+
+    Entry entry;
+    if (!append(m_file, PeaksRecord, key, date, payload, entry) || !m_file.flush()) {
+        qWarning() << "WaveformBuilder :: error :: cannot write cache" << m_fileName;
+        return;
+    }
+    addToIndex(PeaksRecord, key, entry);
+
+    scheduleCompaction();
+}
+
+void NWaveformCache::remove(const QByteArray &key)
+{
+    QMutexLocker locker(&m_mutex);
+    open();
+    QByteArray indexKey = QByteArray(1, (char)PeaksRecord) + key;
+    if (!m_writable || !m_index.contains(indexKey)) {
+        return;
+    }
+
+    m_liveBytes -= m_index.take(indexKey).size;
+    scheduleCompaction();
+}
+
+QByteArray NWaveformCache::fingerprint(const QByteArray &pathKey, const QString &date,
+                                       qint64 fileSize)
+{
+    QMutexLocker locker(&m_mutex);
+    open();
+    QByteArray indexKey = QByteArray(1, (char)PathRecord) + pathKey;
+    if (!m_index.contains(indexKey)) {
+        return QByteArray();
+    }
+
+    Entry &entry = m_index[indexKey];
+    if (entry.date != date || entry.fileSize != fileSize) {
+        return QByteArray();
+    }
+    entry.access = ++m_clock;
+    return entry.fingerprint;
+}
+
+void NWaveformCache::insertPath(const QByteArray &pathKey, const QString &date, qint64 fileSize,
+                                const QByteArray &fingerprint)
+{
+    QByteArray payload;
+    QDataStream outPayload(&payload, QIODevice::WriteOnly);
+    outPayload << fileSize << fingerprint;
+
+    QMutexLocker locker(&m_mutex);
+    open();
+    if (!m_file.isOpen() || !m_writable) {
+        return;
+    }
+
+    Entry entry;
+    if (!append(m_file, PathRecord, pathKey, date, payload, entry) || !m_file.flush()) {
+        qWarning() << "WaveformBuilder :: error :: cannot write cache" << m_fileName;
+        return;
+    }
+    entry.fileSize = fileSize;
+    entry.fingerprint = fingerprint;
+    addToIndex(PathRecord, pathKey, entry);
+
+    scheduleCompaction();
+}
+
+void NWaveformCache::scheduleCompaction()
+{
+    qint64 wasted = m_file.size() - HEADER_SIZE - m_liveBytes;
+    bool overBudget = (m_maxSize > 0 && m_file.size() > m_maxSize);
+    if (m_compacting || (!overBudget && (wasted < COMPACT_MIN_BYTES || wasted < m_liveBytes))) {
+        return;
+    }
+
+    m_compacting = true;
+    m_pool.start(new NWaveformCacheCompaction(this));
+}
+
+void NWaveformCache::compact()
+{
+    QHash<QByteArray, Entry> snapshot;
+    qint64 snapshotEnd;
+    qint64 maxSize;
+    {
+        QMutexLocker locker(&m_mutex);
+        open();
+        if (!m_file.isOpen() || !m_writable) {
+            m_compacting = false;
+            return;
+        }
+        snapshot = m_index;
+        snapshotEnd = m_file.size();
+        maxSize = m_maxSize;
+    }
+
+    // least recently used first:
+    QMap<quint64, QByteArray> byAccess;
+    qint64 liveBytes = 0;
+    for (QHash<QByteArray, Entry>::const_iterator it = snapshot.constBegin();
+         it != snapshot.constEnd(); ++it) {
+        byAccess.insert(it.value().access, it.key());
+        liveBytes += it.value().size;
+    }
+
+    // evict peaks together with the paths leading to them:
+    QSet<QByteArray> evicted;
+    int evictedPeaks = 0;
+    if (maxSize > 0 && liveBytes > maxSize) {
+        QHash<QByteArray, QList<QByteArray>> paths;
+        for (QHash<QByteArray, Entry>::const_iterator it = snapshot.constBegin();
+             it != snapshot.constEnd(); ++it) {
+            if (it.key().at(0) == (char)PathRecord) {
+                paths[QByteArray(1, (char)PeaksRecord) + it.value().fingerprint] << it.key();
+            }
+        }
+
+        qint64 targetBytes = maxSize * EVICT_TO_PERCENT / 100;
+        foreach (const QByteArray &indexKey, byAccess) {
+            if (liveBytes <= targetBytes) {
+                break;
+            }
+            if (indexKey.at(0) != (char)PeaksRecord) {
+                continue;
+            }
+            evicted << indexKey;
+            liveBytes -= snapshot.value(indexKey).size;
+            ++evictedPeaks;
+            foreach (const QByteArray &pathKey, paths.value(indexKey)) {
+                evicted << pathKey;
+                liveBytes -= snapshot.value(pathKey).size;
+            }
+        }
+    }
+
+    // records below snapshotEnd are never modified, copy them without blocking lookups:
+    QFile source(m_fileName);
+    QSaveFile target(m_fileName);
+    if (!source.open(QIODevice::ReadOnly) || !target.open(QIODevice::WriteOnly)) {
+        qWarning() << "WaveformBuilder :: error :: cannot compact cache" << m_fileName;
+        QMutexLocker locker(&m_mutex);
+        m_compacting = false;
+        return;
+    }
+
+    // in the order of use, so that the next scan restores it:
+    QDataStream outFile(&target);
+    outFile << (quint32)CACHE_MAGIC << (quint32)CACHE_VERSION;
+    qint64 written = HEADER_SIZE;
+    QHash<QByteArray, qint64> moved;
+    foreach (const QByteArray &indexKey, byAccess) {
+        if (evicted.contains(indexKey)) {
+            continue;
+        }
+        const Entry &entry = snapshot[indexKey];
+        source.seek(entry.offset);
+        target.write(source.read(entry.size));
+        moved.insert(indexKey, written);
+        written += entry.size;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_compacting = false;
+
+    // records appended meanwhile are carried over as they are:
+    source.seek(snapshotEnd);
+    target.write(source.read(m_file.size() - snapshotEnd));
+    source.close();
+
+    QHash<QByteArray, Entry> index = m_index;
+    for (QHash<QByteArray, Entry>::iterator it = index.begin(); it != index.end();) {
+        if (it.value().offset >= snapshotEnd) {
+            it.value().offset += written - snapshotEnd;
+        } else if (moved.contains(it.key())) {
+            it.value().offset = moved.value(it.key());
+        } else {
+            it = index.erase(it);
+            continue;
+        }
+        ++it;
+    }
+
+    m_file.close();
+    if (target.commit()) {
+        m_index = index;
+        m_liveBytes = 0;
+        foreach (const Entry &entry, m_index) {
+            m_liveBytes += entry.size;
+        }
+        m_evictions += evictedPeaks;
+    } else {
+        qWarning() << "WaveformBuilder :: error :: cannot compact cache" << m_fileName;
+    }
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "WaveformBuilder :: error :: cannot open cache" << m_fileName;
+    }
+}
+
+void NWaveformCache::setMaxSize(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxSize = bytes;
+}
+
+qint64 NWaveformCache::size()
+{
+    QMutexLocker locker(&m_mutex);
+    open();
+    return m_file.isOpen() ? m_file.size() : 0;
+}
+
+qint64 NWaveformCache::evictions()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_evictions;
+}
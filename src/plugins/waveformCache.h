@@ -0,0 +1,98 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#ifndef N_WAVEFORM_CACHE_H
+#define N_WAVEFORM_CACHE_H
+
+#include <QFile>
+#include <QHash>
+#include <QLockFile>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+
+#include "waveformPeaks.h"
+
+// On-disk peaks store: an append-only log of compressed per-file records.
+// Opening it scans only the record headers into an in-memory index, a lookup
+// reads and decompresses a single record, an insert appends a single record.
+// Superseded and, past the size budget, least recently used records are dropped
+// by a compaction pass on a worker thread, which also orders the log by use.
+// Peaks are keyed by content, a secondary index maps paths to content keys. Peaks
+// stored under a path by older versions are dropped once that path is mapped.
+// Only one process writes the log, others opening it meanwhile only read it.
+class NWaveformCache
+{
+private:
+    enum RecordType
+    {
+        PeaksRecord = 0,
+        PathRecord = 1
+    };
+
+    struct Entry
+    {
+        QString date;
+        qint64 offset; // of the record header
+        qint64 size;   // of the whole record
+        qint64 fileSize;        // path records only
+        QByteArray fingerprint; // path records only
+        quint64 access;         // order of the last use
+    };
+
+    QString m_fileName;
+    QFile m_file;
+    QHash<QByteArray, Entry> m_index; // record type byte + key
+    bool m_opened;
+    QLockFile m_lock;
+    bool m_writable; // holds the lock
+    qint64 m_liveBytes;
+    qint64 m_maxSize;
+    quint64 m_clock;
+    qint64 m_evictions;
+    bool m_compacting;
+    QMutex m_mutex;
+    QThreadPool m_pool;
+
+    void open();
+    bool scan();
+    void migrate(quint32 version);
+    bool append(QFile &file, RecordType type, const QByteArray &key, const QString &date,
+                const QByteArray &payload, Entry &entry);
+    void addToIndex(RecordType type, const QByteArray &key, Entry entry);
+    void scheduleCompaction();
+
+public:
+    NWaveformCache(const QString &fileName);
+    ~NWaveformCache();
+
+    bool contains(const QByteArray &key);
+    QString date(const QByteArray &key);
+    bool read(const QByteArray &key, NWaveformPeaks &peaks);
+    void insert(const QByteArray &key, const QString &date, const NWaveformPeaks &peaks);
+    void remove(const QByteArray &key); // dropped from the log by the next compaction
+
+    // content key of a path, empty unless both date and size match:
+    QByteArray fingerprint(const QByteArray &pathKey, const QString &date, qint64 fileSize);
+    void insertPath(const QByteArray &pathKey, const QString &date, qint64 fileSize,
+                    const QByteArray &fingerprint);
+    void compact();
+
+    void setMaxSize(qint64 bytes); // least recently used peaks are evicted when compacting
+    qint64 size();
+    qint64 evictions();
+};
+
+#endif
@@ -424,7 +424,7 @@ void NPreferencesDialog::loadSettings()
         if (objectName == "qt_spinbox_lineedit") { // QSpinBox inner widget
             continue;
         }
-        if (objectName.startsWith("tooltipOffset")) {
+        if (objectName.startsWith("tooltipOffset") || objectName == "accurateSeekFormatsLineEdit") {
             continue;
         }
         QString settingsName = objectName;
@@ -491,6 +491,11 @@ void NPreferencesDialog::loadSettings()
     ui.tooltipOffsetYSpinBox->setValue(offsetList.at(1).toInt());
     // << tooltip offset
 
+    // accurate seek formats >>
+    ui.accurateSeekFormatsLineEdit->setText(
+        NSettings::instance()->value("AccurateSeekFormats").toStringList().join(", "));
+    // << accurate seek formats
+
     // skins >>
 #ifndef _N_NO_SKINS_
     int skinIndex;
@@ -570,7 +575,7 @@ void NPreferencesDialog::saveSettings()
         if (objectName == "qt_spinbox_lineedit") { // QSpinBox inner widget
             continue;
         }
-        if (objectName.startsWith("tooltipOffset")) {
+        if (objectName.startsWith("tooltipOffset") || objectName == "accurateSeekFormatsLineEdit") {
             continue;
         }
         QString settingsName = objectName;
@@ -620,6 +625,20 @@ void NPreferencesDialog::saveSettings()
                                                          << QString::number(tooltipOffsetY));
     // << tooltip offset
 
+    // accurate seek formats >>
+    QStringList accurateSeekFormats;
+    foreach (QString format, ui.accurateSeekFormatsLineEdit->text().split(',')) {
+        format = format.trimmed().toLower();
+        if (format.startsWith('.')) {
+            format.remove(0, 1);
+        }
+        if (!format.isEmpty()) {
+            accurateSeekFormats << format;
+        }
+    }
+    NSettings::instance()->setValue("AccurateSeekFormats", accurateSeekFormats);
+    // << accurate seek formats
+
     // plugins >>
     NFlagIterator<N::PluginType> iter(N::MaxPlugin);
     while (iter.hasNext()) {
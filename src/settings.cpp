@@ -74,12 +74,10 @@ NSettings::NSettings(QObject *parent)
     initValue("Shortcuts/SpeedResetAction", "Backspace");
     initValue("SpeedStep", 0.01);
 
-    /*
     initValue("Shortcuts/PitchIncreaseAction", "}");
     initValue("Shortcuts/PitchDecreaseAction", "{");
     initValue("Shortcuts/PitchResetAction", "Shift+Backspace");
     initValue("PitchStep", 0.01);
-    */
 
     {
         QStringList fullScreenKeys;
@@ -119,6 +117,12 @@ NSettings::NSettings(QObject *parent)
     initValue("LoadNextSort", QDir::Name);
     initValue("Volume", 0.8);
     initValue("ShowDecibelsVolume", false);
+    initValue("Crossfade", 0.0); // seconds, 0 for gapless playback
+    // seeked exactly rather than to the nearest key unit:
+    initValue("AccurateSeekFormats", QStringList() << "flac" << "oga" << "ogg" << "opus" << "wav");
+    initValue("WaveformSharedDecode", false);
+    initValue("WaveformCacheMemoryMB", 32);
+    initValue("WaveformCacheDiskMB", 512);
 
 #ifdef Q_OS_WIN
     initValue("TaskbarProgress", true);
@@ -0,0 +1,269 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#include "tagCache.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QSaveFile>
+
+#define CACHE_MAGIC 0x4E544147 // "NTAG"
+#define CACHE_VERSION 1
+#define HEADER_SIZE 8
+#define RECORD_MAGIC 0x4E524543 // "NREC"
+#define COMPACT_MIN_BYTES (1024 * 1024)
+
+NTagCache::NTagCache(const QString &fileName)
+{
+    m_fileName = fileName;
+    m_map = NULL;
+    m_mapSize = 0;
+    m_opened = false;
+    m_liveBytes = 0;
+}
+
+NTagCache::~NTagCache()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+    }
+    m_file.close();
+}
+
+void NTagCache::open()
+{
+    if (m_opened) {
+        return;
+    }
+    m_opened = true;
+
+    m_file.setFileName(m_fileName);
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "TagCache :: error :: cannot open cache" << m_fileName;
+        return;
+    }
+
+    QDataStream inFile(&m_file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    if (m_file.size() > 0) {
+        inFile >> magic >> version;
+    }
+
+    if (magic == CACHE_MAGIC && version > CACHE_VERSION) {
+        qWarning() << "TagCache :: unsupported cache version" << version;
+        m_file.close();
+        return;
+    }
+
+    if (m_file.size() > 0 && (magic != CACHE_MAGIC || version != CACHE_VERSION)) {
+        m_file.resize(0); // tags are cheap to read again, nothing to migrate
+    }
+
+    if (!scan()) {
+        m_file.close();
+        return;
+    }
+
+    qint64 wasted = m_file.size() - HEADER_SIZE - m_liveBytes;
+    if (wasted >= COMPACT_MIN_BYTES && wasted >= m_liveBytes) {
+        compact();
+    }
+
+    // records appended from now on are read through the file:
+    if (m_file.isOpen() && m_file.size() > HEADER_SIZE) {
+        m_map = m_file.map(0, m_file.size());
+        m_mapSize = m_map ? m_file.size() : 0;
+    }
+}
+
+void NTagCache::addToIndex(const QString &path, const Entry &entry)
+{
+    if (m_index.contains(path)) {
+        m_liveBytes -= m_index.value(path).size;
+    }
+    m_index.insert(path, entry);
+    m_liveBytes += entry.size;
+}
+
+bool NTagCache::scan()
+{
+    m_index.clear();
+    m_liveBytes = 0;
+
+    qint64 fileSize = m_file.size();
+    if (fileSize < HEADER_SIZE) {
+        m_file.resize(0);
+        m_file.seek(0);
+        QDataStream outFile(&m_file);
+        outFile << (quint32)CACHE_MAGIC << (quint32)CACHE_VERSION;
+        return m_file.flush();
+    }
+
+    // only the record headers are read, tags are skipped:
+    QDataStream inFile(&m_file);
+    qint64 offset = HEADER_SIZE;
+    m_file.seek(offset);
+    while (offset < fileSize) {
+        quint32 magic;
+        QString path;
+        Entry entry;
+        quint32 payloadSize;
+        inFile >> magic;
+        if (magic != RECORD_MAGIC) {
+            break;
+        }
+        inFile >> path >> entry.fileSize >> entry.modified >> entry.encoding >> payloadSize;
+        qint64 end = m_file.pos() + payloadSize;
+        if (inFile.status() != QDataStream::Ok || end > fileSize) {
+            break;
+        }
+
+        entry.offset = offset;
+        entry.size = end - offset;
+        m_file.seek(end);
+
+        addToIndex(path, entry);
+        offset = end;
+    }
+
+    if (offset < fileSize) { // interrupted write
+        qWarning() << "TagCache :: truncating damaged cache at" << offset;
+        m_file.resize(offset);
+    }
+
+    return true;
+}
+
+void NTagCache::compact()
+{
+    QSaveFile target(m_fileName);
+    if (!target.open(QIODevice::WriteOnly)) {
+        qWarning() << "TagCache :: error :: cannot compact cache" << m_fileName;
+        return;
+    }
+
+    QDataStream outFile(&target);
+    outFile << (quint32)CACHE_MAGIC << (quint32)CACHE_VERSION;
+    QHash<QString, Entry> index;
+    for (QHash<QString, Entry>::const_iterator it = m_index.constBegin();
+         it != m_index.constEnd(); ++it) {
+        Entry entry = it.value();
+        m_file.seek(entry.offset);
+        QByteArray bytes = m_file.read(entry.size);
+        entry.offset = target.pos();
+        target.write(bytes);
+        index.insert(it.key(), entry);
+    }
+
+    m_file.close();
+    if (target.commit()) {
+        m_index = index;
+    } else {
+        qWarning() << "TagCache :: error :: cannot compact cache" << m_fileName;
+    }
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "TagCache :: error :: cannot open cache" << m_fileName;
+    }
+}
+
+bool NTagCache::append(QFile &file, const QString &path, qint64 fileSize, qint64 modified,
+                       const QString &encoding, const QByteArray &payload, Entry &entry)
+{
+    entry.offset = file.size();
+    file.seek(entry.offset);
+    QDataStream outFile(&file);
+    outFile << (quint32)RECORD_MAGIC << path << fileSize << modified << encoding << payload;
+    entry.size = file.pos() - entry.offset;
+    entry.fileSize = fileSize;
+    entry.modified = modified;
+    entry.encoding = encoding;
+    return outFile.status() == QDataStream::Ok;
+}
+
+QByteArray NTagCache::record(const Entry &entry)
+{
+    if (entry.offset + entry.size <= m_mapSize) {
+        return QByteArray::fromRawData(reinterpret_cast<const char *>(m_map) + entry.offset,
+                                       entry.size);
+    }
+
+    m_file.seek(entry.offset);
+    return m_file.read(entry.size);
+}
+
+bool NTagCache::read(const QString &path, qint64 fileSize, qint64 modified,
+                     const QString &encoding, QMap<QChar, QString> &tags)
+{
+    QMutexLocker locker(&m_mutex);
+    open();
+    QHash<QString, Entry>::const_iterator it = m_index.constFind(path);
+    if (!m_file.isOpen() || it == m_index.constEnd()) {
+        return false;
+    }
+
+    const Entry &entry = it.value();
+    if (entry.fileSize != fileSize || entry.modified != modified || entry.encoding != encoding) {
+        return false;
+    }
+
+    QByteArray bytes = record(entry);
+    QDataStream inRecord(bytes);
+    quint32 magic;
+    QString recordPath;
+    qint64 recordFileSize;
+    qint64 recordModified;
+    QString recordEncoding;
+    QByteArray payload;
+    inRecord >> magic >> recordPath >> recordFileSize >> recordModified >> recordEncoding >>
+        payload;
+    if (inRecord.status() != QDataStream::Ok || magic != RECORD_MAGIC || recordPath != path) {
+        qWarning() << "TagCache :: error :: damaged cache record";
+        return false;
+    }
+
+    QDataStream inPayload(payload);
+    inPayload >> tags;
+    return inPayload.status() == QDataStream::Ok;
+}
+
+void NTagCache::insert(const QString &path, qint64 fileSize, qint64 modified,
+                       const QString &encoding, const QMap<QChar, QString> &tags)
+{
+    QByteArray payload;
+    QDataStream outPayload(&payload, QIODevice::WriteOnly);
+    outPayload << tags;
+
+    QMutexLocker locker(&m_mutex);
+    open();
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    Entry entry;
+    if (!append(m_file, path, fileSize, modified, encoding, payload, entry) ||
+        !m_file.flush()) {
+        qWarning() << "TagCache :: error :: cannot write cache" << m_fileName;
+        return;
+    }
+    addToIndex(path, entry);
+}
+
+qint64 NTagCache::size()
+{
+    QMutexLocker locker(&m_mutex);
+    open();
+    return m_file.size();
+}
@@ -0,0 +1,70 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#ifndef N_TAG_CACHE_H
+#define N_TAG_CACHE_H
+
+#include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+
+// On-disk store of the tags of files: an append-only log of records, keyed by path and
+// valid as long as both the size and the modification time of the file match. Opening
+// it scans only the record headers into an in-memory index and maps the log into memory,
+// a hit is read from the mapping without touching the tagged file. Superseded records
+// are dropped by compacting the log when it is opened.
+class NTagCache
+{
+private:
+    struct Entry
+    {
+        qint64 offset; // of the record header
+        qint64 size;   // of the whole record
+        qint64 fileSize;
+        qint64 modified; // msecs since epoch
+        QString encoding;
+    };
+
+    QString m_fileName;
+    QFile m_file;
+    QHash<QString, Entry> m_index;
+    uchar *m_map;
+    qint64 m_mapSize; // records past it were appended since the log was mapped
+    bool m_opened;
+    qint64 m_liveBytes;
+    QMutex m_mutex;
+
+    void open();
+    bool scan();
+    void compact();
+    bool append(QFile &file, const QString &path, qint64 fileSize, qint64 modified,
+                const QString &encoding, const QByteArray &payload, Entry &entry);
+    void addToIndex(const QString &path, const Entry &entry);
+    QByteArray record(const Entry &entry);
+
+public:
+    NTagCache(const QString &fileName);
+    ~NTagCache();
+
+    bool read(const QString &path, qint64 fileSize, qint64 modified, const QString &encoding,
+              QMap<QChar, QString> &tags);
+    void insert(const QString &path, qint64 fileSize, qint64 modified, const QString &encoding,
+                const QMap<QChar, QString> &tags);
+    qint64 size();
+};
+
+#endif
@@ -16,6 +16,25 @@
 #include "trackInfoReader.h"
 #include "pluginLoader.h"
 #include "settings.h"
+#include "tagCache.h"
+
+#define READER_TAGS "atAcgynbDBsHM" // all the tag reader supports
+
+static const QStringList _formatKeys = QStringList() << "PlaylistTrackInfo"
+                                                     << "WindowTitleTrackInfo"
+                                                     << "TooltipTrackInfo";
+
+// the given tags which the cache entry doesn't have:
+static QString _missingTags(const QString &tags, const QMap<QChar, QString> &cached)
+{
+    QString missing;
+    foreach (QChar ch, tags) {
+        if (!cached.contains(ch)) {
+            missing += ch;
+        }
+    }
+    return missing;
+}
 
 QString NTrackInfoReader::formatTime(int durationSec)
 {
@@ -30,6 +49,35 @@ QString NTrackInfoReader::formatTime(int durationSec)
     }
 }
 
+void NTrackInfoReader::loadSettings()
+{
+    QStringList keys = _formatKeys;
+    foreach (QString key, NSettings::instance()->allKeys()) {
+        if (key.startsWith("TrackInfo/")) {
+            keys << key;
+        }
+    }
+
+    // duration is needed regardless, for the playlist:
+    QString tags = "D";
+    foreach (QString key, keys) {
+        QString format = NSettings::instance()->value(key).toString();
+        for (int i = format.indexOf('%'); i >= 0 && i + 1 < format.size();
+             i = format.indexOf('%', i + 2)) {
+            QChar ch = format.at(i + 1);
+            if (QString(READER_TAGS).contains(ch) && !tags.contains(ch)) {
+                tags += ch;
+            }
+        }
+    }
+    m_cachedTags = tags;
+}
+
+QString NTrackInfoReader::cachedTags() const
+{
+    return m_cachedTags;
+}
+
 NTrackInfoReader::NTrackInfoReader(NTagReaderInterface *tagReader, QObject *parent)
     : QObject(parent)
 {
@@ -37,15 +85,68 @@ NTrackInfoReader::NTrackInfoReader(NTagReaderInterface *tagReader, QObject *pare
     m_playlistDurationSec = -1;
     m_reader = tagReader;
     Q_ASSERT(m_reader);
+    m_cache = NULL;
+    m_cached = false;
+    m_readerBehind = false;
+    loadSettings();
+}
+
+void NTrackInfoReader::setCache(NTagCache *cache)
+{
+    m_cache = cache;
 }
 
 void NTrackInfoReader::setSource(const QString &file)
 {
     m_fileInfo = QFileInfo(file);
-    m_reader->setSource(file);
-    m_reader->setEncoding(NSettings::instance()->value("EncodingTrackInfo").toString());
+    m_encoding = NSettings::instance()->value("EncodingTrackInfo").toString();
+    m_cached = false;
+    m_readerBehind = false;
+
+    // a hit costs a stat of the file, which is neither opened nor parsed:
+    bool cacheable = m_cache && !file.isEmpty() && m_fileInfo.isFile();
+    qint64 fileSize = cacheable ? m_fileInfo.size() : 0;
+    qint64 modified = cacheable ? m_fileInfo.lastModified().toMSecsSinceEpoch() : 0;
+    m_tags.clear();
+    QString missing;
+    if (cacheable) {
+        if (!m_cache->read(file, fileSize, modified, m_encoding, m_tags)) {
+            m_tags.clear();
+        }
+        missing = _missingTags(m_cachedTags, m_tags);
+    }
+    if (cacheable && missing.isEmpty()) {
+        m_cached = true;
+        m_readerBehind = true;
+    } else {
+        m_reader->setSource(file);
+        m_reader->setEncoding(m_encoding);
+        if (cacheable) {
+            foreach (QChar ch, missing) {
+                m_tags[ch] = m_reader->getTag(ch);
+            }
+            m_cache->insert(file, fileSize, modified, m_encoding, m_tags);
+            m_cached = true;
+        }
+    }
 
-    QString seconds = m_reader->getTag('D');
+    sourceChanged();
+}
+
+void NTrackInfoReader::setSource(const NTagData &data)
+{
+    m_fileInfo = QFileInfo(data.file);
+    m_encoding = NSettings::instance()->value("EncodingTrackInfo").toString();
+    m_tags = data.tags;
+    m_cached = true;
+    m_readerBehind = true;
+
+    sourceChanged();
+}
+
+void NTrackInfoReader::sourceChanged()
+{
+    QString seconds = getTag('D');
     if (seconds.isEmpty()) {
         m_durationSec = -1;
     } else {
@@ -54,6 +155,58 @@ void NTrackInfoReader::setSource(const QString &file)
     m_positionSec = -1;
 }
 
+bool NTrackInfoReader::canReadMany() const
+{
+    return m_reader->isReadManyThreadSafe();
+}
+
+QList<NTagData> NTrackInfoReader::readMany(const QStringList &files, const QString &tags,
+                                           const QString &encoding) const
+{
+    QList<NTagData> results;
+    QStringList misses;
+    QList<int> missIndexes;
+    QList<QFileInfo> missInfos;
+    foreach (QString file, files) {
+        NTagData data;
+        data.file = file;
+        QFileInfo fileInfo(file);
+        if (m_cache && fileInfo.isFile()) {
+            if (!m_cache->read(file, fileInfo.size(),
+                               fileInfo.lastModified().toMSecsSinceEpoch(), encoding,
+                               data.tags)) {
+                data.tags.clear();
+            } else if (_missingTags(tags, data.tags).isEmpty()) {
+                results << data;
+                continue;
+            }
+        }
+        misses << file;
+        missIndexes << results.size();
+        missInfos << fileInfo;
+        results << data;
+    }
+
+    if (misses.isEmpty()) {
+        return results;
+    }
+
+    // tags cached for other formats are kept along:
+    QList<NTagData> read = m_reader->readMany(misses, tags, encoding);
+    for (int i = 0; i < read.size(); ++i) {
+        QMap<QChar, QString> &merged = results[missIndexes.at(i)].tags;
+        foreach (QChar ch, read.at(i).tags.keys()) {
+            merged[ch] = read.at(i).tags.value(ch);
+        }
+        const QFileInfo &fileInfo = missInfos.at(i);
+        if (m_cache && fileInfo.isFile()) {
+            m_cache->insert(misses.at(i), fileInfo.size(),
+                            fileInfo.lastModified().toMSecsSinceEpoch(), encoding, merged);
+        }
+    }
+    return results;
+}
+
 void NTrackInfoReader::updatePlaybackPosition(int seconds)
 {
     m_positionSec = seconds;
@@ -120,8 +273,22 @@ QString NTrackInfoReader::getInfo(QChar ch) const
         case 'v':
             return QCoreApplication::applicationVersion();
         default:
-            return m_reader->getTag(ch);
+            return getTag(ch);
+    }
+}
+
+QString NTrackInfoReader::getTag(QChar ch) const
+{
+    if (m_cached && m_tags.contains(ch)) {
+        return m_tags.value(ch);
+    }
+
+    if (m_readerBehind) {
+        m_reader->setSource(m_fileInfo.filePath());
+        m_reader->setEncoding(m_encoding);
+        m_readerBehind = false;
     }
+    return m_reader->getTag(ch);
 }
 
 QString NTrackInfoReader::parseFormat(const QString &format, int &cur, bool skip, bool &ok) const
@@ -21,25 +21,49 @@
 #include <QFileInfo>
 #include <QObject>
 
+class NTagCache;
+
 class NTrackInfoReader : public QObject
 {
     Q_OBJECT
 
 private:
     NTagReaderInterface *m_reader;
+    NTagCache *m_cache;
     QFileInfo m_fileInfo;
+    QString m_encoding;
+    bool m_cached;               // m_tags hold the tags of the source
+    mutable bool m_readerBehind; // the tag reader is still set to an older source
+    QMap<QChar, QString> m_tags;
+    QString m_cachedTags;
 
     int m_durationSec;
     int m_positionSec;
     int m_playlistDurationSec;
 
     QString parseFormat(const QString &format, int &cur, bool skip, bool &ok) const;
+    QString getTag(QChar ch) const;
+    void sourceChanged();
 
 public:
     NTrackInfoReader(NTagReaderInterface *tagReader, QObject *parent = 0);
     ~NTrackInfoReader() {}
 
+    void setCache(NTagCache *cache);
     void setSource(const QString &file);
+    void setSource(const NTagData &data); // as returned by readMany()
+
+    // tags of many files, from the cache or else the tag reader, from any thread if
+    // canReadMany(). Doesn't change the source:
+    bool canReadMany() const;
+    QList<NTagData> readMany(const QStringList &files, const QString &tags,
+                             const QString &encoding) const;
+
+    // tag characters the track info formats use, which are the ones cached, as of the last
+    // loadSettings():
+    void loadSettings();
+    QString cachedTags() const;
+
     void updatePlaybackPosition(int seconds);
     void updatePlaylistDuration(int seconds);
     QString toString(const QString &format) const;
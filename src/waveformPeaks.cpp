@@ -16,48 +16,326 @@
 #include "waveformPeaks.h"
 
 #include <QDebug>
+#include <QtEndian>
+#include <QtMath>
+#include <climits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define N_X86_KERNELS
+#endif
 
 #define MAX_RES 2048
+#define QUANT_MAX 32767
+#define STORAGE_BITS 8
+
+// Minimum and maximum of the per-frame channel sums of interleaved S16 PCM.
+typedef void (*NMinMaxKernel)(const qint16 *pcm, int channels, int frames, qint32 &min,
+                              qint32 &max);
+
+static void _minMaxScalar(const qint16 *pcm, int channels, int frames, qint32 &min, qint32 &max)
+{
+    for (int i = 0; i < frames; ++i) {
+        qint32 sum = 0;
+        for (int j = 0; j < channels; ++j) {
+            sum += pcm[i * channels + j];
+        }
+        min = qMin(min, sum);
+        max = qMax(max, sum);
+    }
+}
+
+#ifdef N_X86_KERNELS
+__attribute__((target("sse2"))) static inline __m128i _minEpi32(__m128i a, __m128i b)
+{
+    __m128i mask = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(mask, b), _mm_andnot_si128(mask, a));
+}
+
+__attribute__((target("sse2"))) static inline __m128i _maxEpi32(__m128i a, __m128i b)
+{
+    __m128i mask = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+__attribute__((target("sse2"))) static void _minMaxSse2(const qint16 *pcm, int channels,
+                                                         int frames, qint32 &min, qint32 &max)
+{
+    int i = 0;
+    if (channels == 1) {
+        __m128i vmin = _mm_set1_epi16(SHRT_MAX);
+        __m128i vmax = _mm_set1_epi16(SHRT_MIN);
+        for (; i + 8 <= frames; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pcm + i));
+            vmin = _mm_min_epi16(vmin, v);
+            vmax = _mm_max_epi16(vmax, v);
+        }
+        qint16 mins[8];
+        qint16 maxs[8];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(mins), vmin);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(maxs), vmax);
+        for (int j = 0; j < 8; ++j) {
+            min = qMin(min, (qint32)mins[j]);
+            max = qMax(max, (qint32)maxs[j]);
+        }
+    } else if (channels == 2) {
+        // pairwise add of left and right samples into 32-bit sums:
+        __m128i ones = _mm_set1_epi16(1);
+        __m128i vmin = _mm_set1_epi32(INT_MAX);
+        __m128i vmax = _mm_set1_epi32(INT_MIN);
+        for (; i + 4 <= frames; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pcm + i * 2));
+            __m128i sums = _mm_madd_epi16(v, ones);
+            vmin = _minEpi32(vmin, sums);
+            vmax = _maxEpi32(vmax, sums);
+        }
+        qint32 mins[4];
+        qint32 maxs[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(mins), vmin);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(maxs), vmax);
+        for (int j = 0; j < 4; ++j) {
+            min = qMin(min, mins[j]);
+            max = qMax(max, maxs[j]);
+        }
+    }
+    _minMaxScalar(pcm + i * channels, channels, frames - i, min, max);
+}
+
+__attribute__((target("avx2"))) static void _minMaxAvx2(const qint16 *pcm, int channels,
+                                                         int frames, qint32 &min, qint32 &max)
+{
+    int i = 0;
+    if (channels == 1) {
+        __m256i vmin = _mm256_set1_epi16(SHRT_MAX);
+        __m256i vmax = _mm256_set1_epi16(SHRT_MIN);
+        for (; i + 16 <= frames; i += 16) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pcm + i));
+            vmin = _mm256_min_epi16(vmin, v);
+            vmax = _mm256_max_epi16(vmax, v);
+        }
+        qint16 mins[16];
+        qint16 maxs[16];
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(mins), vmin);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(maxs), vmax);
+        for (int j = 0; j < 16; ++j) {
+            min = qMin(min, (qint32)mins[j]);
+            max = qMax(max, (qint32)maxs[j]);
+        }
+    } else if (channels == 2) {
+        __m256i ones = _mm256_set1_epi16(1);
+        __m256i vmin = _mm256_set1_epi32(INT_MAX);
+        __m256i vmax = _mm256_set1_epi32(INT_MIN);
+        for (; i + 8 <= frames; i += 8) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pcm + i * 2));
+            __m256i sums = _mm256_madd_epi16(v, ones);
+            vmin = _mm256_min_epi32(vmin, sums);
+            vmax = _mm256_max_epi32(vmax, sums);
+        }
+        qint32 mins[8];
+        qint32 maxs[8];
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(mins), vmin);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(maxs), vmax);
+        for (int j = 0; j < 8; ++j) {
+            min = qMin(min, mins[j]);
+            max = qMax(max, maxs[j]);
+        }
+    }
+    _minMaxScalar(pcm + i * channels, channels, frames - i, min, max);
+}
+#endif
+
+static NMinMaxKernel _minMaxKernel()
+{
+#ifdef N_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return _minMaxAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return _minMaxSse2;
+    }
+#endif
+    return _minMaxScalar;
+}
+
+static const NMinMaxKernel _minMax = _minMaxKernel();
+
+static inline qint16 _quantize(qreal value)
+{
+    return qBound(-QUANT_MAX, qRound(value * QUANT_MAX), QUANT_MAX);
+}
+
+static inline qreal _dequantize(qint16 value)
+{
+    return (qreal)value / QUANT_MAX;
+}
+
+static inline qint8 _toInt8(qint16 value)
+{
+    return qRound(value * 127.0 / QUANT_MAX);
+}
+
+static inline qint16 _fromInt8(qint8 value)
+{
+    return qRound(value * (qreal)QUANT_MAX / 127);
+}
 
 NWaveformPeaks::NWaveformPeaks()
 {
     reset();
 }
 
+NWaveformPeaks NWaveformPeaks::fromBins(const QVector<QPair<qreal, qreal>> &bins)
+{
+    NWaveformPeaks peaks;
+    foreach (const auto &bin, bins) {
+        peaks.appendBin(bin);
+    }
+    peaks.complete();
+    return peaks;
+}
+
 void NWaveformPeaks::reset()
 {
-    m_index = 0;
-    m_factor = 1024;
-    m_factor_k = 2;
     m_counter = 0;
     m_completed = false;
+    m_bin = qMakePair(0.0, 0.0);
+    m_levels.clear();
+}
 
-    m_vector = QVector<QPair<qreal, qreal>>(MAX_RES, qMakePair(0.0, 0.0));
+int NWaveformPeaks::displayLevel() const
+{
+    for (int level = 0; level < m_levels.size(); ++level) {
+        if (m_levels.at(level).size() <= MAX_RES) {
+            return level;
+        }
+    }
+    return m_levels.size() - 1;
 }
 
 int NWaveformPeaks::size() const
 {
-    if (m_completed) {
-        return m_vector.size();
-    } else {
-        return m_index;
+    int level = displayLevel();
+    if (level < 0) {
+        return 0;
+    }
+    return m_levels.at(level).size();
+}
+
+qreal NWaveformPeaks::positive(int index) const
+{
+    return _dequantize(m_levels.at(displayLevel()).at(index).first);
+}
+
+qreal NWaveformPeaks::negative(int index) const
+{
+    return _dequantize(m_levels.at(displayLevel()).at(index).second);
+}
+
+int NWaveformPeaks::size(int level) const
+{
+    if (level < 0 || level >= m_levels.size()) {
+        return 0;
+    }
+    return m_levels.at(level).size();
+}
+
+qreal NWaveformPeaks::positive(int level, int index) const
+{
+    return _dequantize(m_levels.at(level).at(index).first);
+}
+
+qreal NWaveformPeaks::negative(int level, int index) const
+{
+    return _dequantize(m_levels.at(level).at(index).second);
+}
+
+int NWaveformPeaks::bytes() const
+{
+    int bins = 0;
+    foreach (const QVector<Bin> &level, m_levels) {
+        bins += level.size();
+    }
+    return sizeof(NWaveformPeaks) + bins * sizeof(Bin);
+}
+
+void NWaveformPeaks::range(qreal from, qreal to, qreal &positive, qreal &negative) const
+{
+    positive = 0;
+    negative = 0;
+
+    if (m_levels.isEmpty() || m_levels.first().isEmpty()) {
+        return;
     }
+
+    // the coarsest level, which still has at least one bin within the range:
+    int level = m_levels.size() - 1;
+    while (level > 0 && (to - from) * m_levels.at(level).size() < 1) {
+        --level;
+    }
+
+    const QVector<Bin> &bins = m_levels.at(level);
+    int first = qBound(0, qFloor(from * bins.size()), bins.size() - 1);
+    int last = qBound(first, qCeil(to * bins.size()) - 1, bins.size() - 1);
+    Bin peak(0, 0);
+    for (int i = first; i <= last; ++i) {
+        peak.first = qMax(bins.at(i).first, peak.first);
+        peak.second = qMin(bins.at(i).second, peak.second);
+    }
+    positive = _dequantize(peak.first);
+    negative = _dequantize(peak.second);
 }
 
 void NWaveformPeaks::complete()
 {
+    if (m_counter > 0) {
+        appendBin(m_bin);
+        m_counter = 0;
+    }
+
+    // carry the unpaired tail bins up, so that every level covers the whole track:
+    for (int level = 0; level < m_levels.size(); ++level) {
+        int size = m_levels.at(level).size();
+        if (size > 1 && size % 2 == 1) {
+            Bin tail = m_levels.at(level).last();
+            appendBin(level + 1, tail);
+        }
+    }
+
     m_completed = true;
-    m_vector.resize(m_index + 1);
 }
 
-qreal NWaveformPeaks::positive(int index) const
+void NWaveformPeaks::appendBins(const Bin *bins, int count)
 {
-    return m_vector[index].first;
+    for (int i = 0; i < count; ++i) {
+        appendBin(0, bins[i]);
+    }
 }
 
-qreal NWaveformPeaks::negative(int index) const
+void NWaveformPeaks::appendBin(const QPair<qreal, qreal> &bin)
 {
-    return m_vector[index].second;
+    appendBin(0, Bin(_quantize(bin.first), _quantize(bin.second)));
+}
+
+void NWaveformPeaks::appendBin(int level, const Bin &bin)
+{
+    if (level == m_levels.size()) {
+        m_levels.append(QVector<Bin>());
+#if defined(QT_DEBUG) && !defined(QT_NO_DEBUG)
+        qDebug() << "WaveformPeaks   ::"
+                 << "level    " << level;
+#endif
+    }
+
+    m_levels[level].append(bin);
+
+    int size = m_levels.at(level).size();
+    if (size % 2 == 0) {
+        const Bin &left = m_levels.at(level).at(size - 2);
+        const Bin &right = m_levels.at(level).at(size - 1);
+        Bin merged(qMax(left.first, right.first), qMin(left.second, right.second));
+        appendBin(level + 1, merged);
+    }
 }
 
 void NWaveformPeaks::append(qreal value)
@@ -67,43 +345,132 @@ void NWaveformPeaks::append(qreal value)
         return;
     }
 
-    if (m_index == m_vector.size() - 1) {
-        m_factor *= m_factor_k;
-#if defined(QT_DEBUG) && !defined(QT_NO_DEBUG)
-        qDebug() << "WaveformPeaks   ::"
-                 << "resized  " << m_factor;
-#endif
-
-        qreal max;
-        qreal min;
-        int i;
-        for (i = 0; i < m_vector.size() / m_factor_k; ++i) {
-            max = 0;
-            min = 0;
-            for (int j = 0; j < m_factor_k; ++j) {
-                max = qMax(m_vector[i * m_factor_k + j].first, max);
-                min = qMin(m_vector[i * m_factor_k + j].second, min);
-            }
-            m_vector[i].first = max;
-            m_vector[i].second = min;
-        }
+    m_bin.first = qMax(m_bin.first, value);
+    m_bin.second = qMin(m_bin.second, value);
 
+    if (++m_counter == BaseFactor) {
+        appendBin(m_bin);
+        m_bin = qMakePair(0.0, 0.0);
         m_counter = 0;
-        m_index = i;
+    }
+}
+
+void NWaveformPeaks::appendBlock(const qint16 *pcm, int channels, int frames)
+{
+    if (m_completed) {
+        qWarning() << "WaveformPeaks::appendBlock() : cannot append to completed.";
+        return;
+    }
+
+    if (channels <= 0) {
+        return;
+    }
+
+    // same as append() for every frame with the channels averaged and inverted, scaled in the
+    // same order of operations so that it rounds the same for any channel count:
+    while (frames > 0) {
+        int n = qMin(frames, BaseFactor - m_counter);
+        qint32 min = INT_MAX;
+        qint32 max = INT_MIN;
+        _minMax(pcm, channels, n, min, max);
 
-        for (i = m_index; i < m_vector.size(); ++i) {
-            m_vector[i].first = 0;
-            m_vector[i].second = 0;
+        m_bin.first = qMax(m_bin.first, -((qreal)min / channels) / (1 << 15));
+        m_bin.second = qMin(m_bin.second, -((qreal)max / channels) / (1 << 15));
+
+        m_counter += n;
+        if (m_counter == BaseFactor) {
+            appendBin(m_bin);
+            m_bin = qMakePair(0.0, 0.0);
+            m_counter = 0;
         }
+
+        pcm += n * channels;
+        frames -= n;
+    }
+}
+
+QDataStream &operator<<(QDataStream &out, const NWaveformPeaks &p)
+{
+    // only the finest level is stored, the others are rebuilt on load:
+    QVector<NWaveformPeaks::Bin> bins = p.m_levels.value(0);
+    QByteArray packed(bins.size() * 2, 0);
+    for (int i = 0; i < bins.size(); ++i) {
+        packed[i * 2] = _toInt8(bins.at(i).first);
+        packed[i * 2 + 1] = _toInt8(bins.at(i).second);
     }
+    out << (quint8)STORAGE_BITS << packed << p.m_completed;
+    return out;
+}
 
-    if (m_counter < m_factor) {
-        ++m_counter;
+QDataStream &operator>>(QDataStream &in, NWaveformPeaks &p)
+{
+    quint8 bits;
+    QByteArray packed;
+    bool completed;
+    in >> bits >> packed >> completed;
+
+    p.reset();
+    if (bits == 8) {
+        const qint8 *data = reinterpret_cast<const qint8 *>(packed.constData());
+        for (int i = 0; i + 1 < packed.size(); i += 2) {
+            p.appendBin(0, NWaveformPeaks::Bin(_fromInt8(data[i]), _fromInt8(data[i + 1])));
+        }
+    } else if (bits == 16) {
+        const uchar *data = reinterpret_cast<const uchar *>(packed.constData());
+        for (int i = 0; i + 3 < packed.size(); i += 4) {
+            p.appendBin(0, NWaveformPeaks::Bin(qFromLittleEndian<qint16>(data + i),
+                                               qFromLittleEndian<qint16>(data + i + 2)));
+        }
     } else {
-        m_counter = 0;
-        ++m_index;
+        in.setStatus(QDataStream::ReadCorruptData);
+        return in;
+    }
+
+    if (completed) {
+        p.complete();
+    }
+    return in;
+}
+
+NWaveformPeaksRing::NWaveformPeaksRing(int capacity)
+{
+    quint32 size = 1;
+    while (size < (quint32)capacity) {
+        size <<= 1;
     }
+    m_bins.resize(size);
+    m_mask = size - 1;
+    reset();
+}
 
-    m_vector[m_index].first = qMax(m_vector[m_index].first, value);
-    m_vector[m_index].second = qMin(m_vector[m_index].second, value);
+void NWaveformPeaksRing::reset()
+{
+    m_head.storeRelease(0);
+    m_tail.storeRelease(0);
+}
+
+int NWaveformPeaksRing::push(const NWaveformPeaks::Bin *bins, int count)
+{
+    quint32 head = m_head.loadAcquire();
+    quint32 tail = m_tail.loadAcquire();
+    int n = qMin(count, (int)(m_bins.size() - (head - tail)));
+    NWaveformPeaks::Bin *data = m_bins.data();
+    for (int i = 0; i < n; ++i) {
+        data[(head + i) & m_mask] = bins[i];
+    }
+    m_head.storeRelease(head + n); // publishes the bins written above
+    return n;
+}
+
+int NWaveformPeaksRing::pop(NWaveformPeaks::Bin *bins, int maxCount)
+{
+    quint32 tail = m_tail.loadAcquire();
+    quint32 head = m_head.loadAcquire();
+    int n = qMin(maxCount, (int)(head - tail));
+    const NWaveformPeaks::Bin *data = m_bins.constData();
+    for (int i = 0; i < n; ++i) {
+        bins[i] = data[(tail + i) & m_mask];
+    }
+    m_tail.storeRelease(tail + n); // frees the slots read above
+    return n;
 }
@@ -16,42 +16,73 @@
 #ifndef N_WAVEFORM_PEAKS_H
 #define N_WAVEFORM_PEAKS_H
 
+#include <QAtomicInteger>
 #include <QDataStream>
 #include <QPair>
 #include <QVector>
 
+// Peaks are kept as a pyramid: level 0 holds one bin per BaseFactor samples,
+// every next level merges pairs of bins of the previous one. Bins are stored
+// quantized to 16 bits, and to 8 bits when serialized.
 class NWaveformPeaks
 {
+public:
+    typedef QPair<qint16, qint16> Bin;
+    enum { BaseFactor = 1024 }; // samples per level 0 bin
+
 private:
-    QVector<QPair<qreal, qreal>> m_vector;
+    QVector<QVector<Bin>> m_levels;
+    QPair<qreal, qreal> m_bin;
     bool m_completed;
-    int m_index;
-    int m_factor;
-    int m_factor_k;
     int m_counter;
 
+    void appendBin(int level, const Bin &bin);
+    void appendBin(const QPair<qreal, qreal> &bin);
+    int displayLevel() const;
+
 public:
     NWaveformPeaks();
+    static NWaveformPeaks fromBins(const QVector<QPair<qreal, qreal>> &bins);
     void reset();
     void append(qreal value);
+    void appendBlock(const qint16 *pcm, int channels, int frames);
+    void appendBins(const Bin *bins, int count); // to level 0
     void complete();
     bool isCompleted() const { return m_completed; }
+
+    // display level, at most 2048 bins:
     int size() const;
     qreal positive(int index) const;
     qreal negative(int index) const;
 
-    friend inline QDataStream &operator<<(QDataStream &out, const NWaveformPeaks &p)
-    {
-        out << p.m_vector << p.m_index << p.m_completed;
-        return out;
-    }
-
-    friend inline QDataStream &operator>>(QDataStream &in, NWaveformPeaks &p)
-    {
-        p.m_vector.clear();
-        in >> p.m_vector >> p.m_index >> p.m_completed;
-        return in;
-    }
+    int levels() const { return m_levels.size(); }
+    int size(int level) const;
+    qreal positive(int level, int index) const;
+    qreal negative(int level, int index) const;
+    Bin bin(int level, int index) const { return m_levels.at(level).at(index); }
+    void range(qreal from, qreal to, qreal &positive, qreal &negative) const;
+    int bytes() const;
+
+    friend QDataStream &operator<<(QDataStream &out, const NWaveformPeaks &p);
+    friend QDataStream &operator>>(QDataStream &in, NWaveformPeaks &p);
+};
+
+// Hands level 0 bins over from a single producer thread to a single consumer
+// thread without locking: each side only advances its own index. The producer
+// never waits, push() takes as many bins as there is room for.
+class NWaveformPeaksRing
+{
+private:
+    QVector<NWaveformPeaks::Bin> m_bins;
+    quint32 m_mask;
+    QAtomicInteger<quint32> m_head; // written by the producer
+    QAtomicInteger<quint32> m_tail; // written by the consumer
+
+public:
+    NWaveformPeaksRing(int capacity = 16384); // rounded up to a power of two
+    void reset(); // only while neither side is active
+    int push(const NWaveformPeaks::Bin *bins, int count);
+    int pop(NWaveformPeaks::Bin *bins, int maxCount);
 };
 
 #endif
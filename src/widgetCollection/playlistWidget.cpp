@@ -20,7 +20,9 @@
 #include <QMap>
 #include <QMenu>
 #include <QMessageBox>
+#include <QRunnable>
 #include <QScrollBar>
+#include <QSet>
 #include <QShortcut>
 
 #include "action.h"
@@ -33,11 +35,26 @@
 #include "trackInfoReader.h"
 #include "trash.h"
 #include "utils.h"
+#include "waveformBuilderInterface.h"
 
 #ifdef Q_OS_WIN
 #include "winIcon.h"
 #endif
 
+#define PRECOMPUTE_AHEAD 3
+#define RESOLVE_BATCH 32 // files read per pass of the resolver, results are posted per batch
+#define RESOLVE_NOTIFY_MSEC 250
+
+class NPlaylistResolveWorker : public QRunnable
+{
+private:
+    NPlaylistWidget *m_playlistWidget;
+
+public:
+    NPlaylistResolveWorker(NPlaylistWidget *playlistWidget) : m_playlistWidget(playlistWidget) {}
+    void run() { m_playlistWidget->resolveRun(); }
+};
+
 NPlaylistWidget::NPlaylistWidget(QWidget *parent) : QListWidget(parent)
 {
     m_fileDropBorderColor = QColor(Qt::transparent);
@@ -48,10 +65,27 @@ NPlaylistWidget::NPlaylistWidget(QWidget *parent) : QListWidget(parent)
 
     m_trackInfoReader = NULL;
 
+    // a single resolver, readMany() of the tag reader spreads a batch over its own threads:
+    m_resolvePool.setMaxThreadCount(1);
+    m_resolveRunning = false;
+    m_resolveCancelled = false;
+    m_durationSec = 0;
+
+    m_resolvedTimer = new QTimer(this);
+    m_resolvedTimer->setSingleShot(true);
+    m_resolvedTimer->setInterval(RESOLVE_NOTIFY_MSEC);
+    connect(m_resolvedTimer, &QTimer::timeout, [this]() {
+        emit durationChanged(m_durationSec);
+        emit itemsChanged();
+    });
+
     m_playbackEngine = dynamic_cast<NPlaybackEngineInterface *>(
         NPluginLoader::getPlugin(N::PlaybackEngine));
     Q_ASSERT(m_playbackEngine);
 
+    m_waveformBuilder = dynamic_cast<NWaveformBuilderInterface *>(
+        NPluginLoader::getPlugin(N::WaveformBuilder));
+
     QList<QIcon> winIcons;
 #ifdef Q_OS_WIN
     winIcons = NWinIcon::getIcons(QProcessEnvironment::systemEnvironment().value("SystemRoot") +
@@ -69,7 +103,7 @@ NPlaylistWidget::NPlaylistWidget(QWidget *parent) : QListWidget(parent)
     connect(m_playbackEngine, SIGNAL(mediaChanged(const QString &, int)), this,
             SLOT(on_playbackEngine_mediaChanged(const QString &, int)));
     connect(m_playbackEngine, SIGNAL(nextMediaRequested()), this,
-            SLOT(on_playbackEngine_prepareNextMediaRequested()), Qt::BlockingQueuedConnection);
+            SLOT(on_playbackEngine_prepareNextMediaRequested()));
 
     setItemDelegate(new NPlaylistWidgetItemDelegate(this));
     m_playingItem = NULL;
@@ -141,6 +175,7 @@ NPlaylistWidget::NPlaylistWidget(QWidget *parent) : QListWidget(parent)
 
 void NPlaylistWidget::setTrackInfoReader(NTrackInfoReader *reader)
 {
+    resolveStop();
     m_trackInfoReader = reader;
 }
 
@@ -159,16 +194,30 @@ void NPlaylistWidget::startProcessVisibleItemsTimer()
     m_processVisibleItemsTimer->start(30);
 }
 
-void NPlaylistWidget::processVisibleItems()
+void NPlaylistWidget::visibleRows(int &minRow, int &maxRow) const
 {
-    bool emitItemsChanged = false;
-    int minRow = row(itemAt(0, 0));
+    minRow = row(itemAt(0, 0));
     QListWidgetItem *maxItem = itemAt(0, this->height());
-    int maxRow = maxItem ? row(maxItem) : count() - 1;
+    maxRow = maxItem ? row(maxItem) : count() - 1;
 
+    // with a page of margin on both sides:
     int totalRows = maxRow - minRow + 1;
     minRow = qMax(0, minRow - totalRows);
     maxRow = qMin(maxRow + totalRows, count() - 1);
+}
+
+void NPlaylistWidget::processVisibleItems()
+{
+    if (m_trackInfoReader && m_trackInfoReader->canReadMany()) {
+        resolveItems(false);
+        precomputeWaveforms();
+        return;
+    }
+
+    bool emitItemsChanged = false;
+    int minRow;
+    int maxRow;
+    visibleRows(minRow, maxRow);
     QString titleFormat = NSettings::instance()->value("PlaylistTrackInfo").toString();
     for (int i = minRow; i <= maxRow; ++i) {
         emitItemsChanged = refreshItemData(itemAtRow(i), titleFormat) || emitItemsChanged;
@@ -177,6 +226,188 @@ void NPlaylistWidget::processVisibleItems()
     if (emitItemsChanged) {
         emit itemsChanged();
     }
+
+    precomputeWaveforms();
+}
+
+void NPlaylistWidget::processItems()
+{
+    if (m_trackInfoReader && m_trackInfoReader->canReadMany()) {
+        resolveItems(true);
+        precomputeWaveforms();
+    } else {
+        processVisibleItems();
+    }
+}
+
+void NPlaylistWidget::resolveItems(bool all)
+{
+    int minRow;
+    int maxRow;
+    visibleRows(minRow, maxRow);
+    QString titleFormat = NSettings::instance()->value("PlaylistTrackInfo").toString();
+
+    QList<QPair<int, QString>> visible;
+    QSet<int> visibleIds;
+    for (int i = minRow; i <= maxRow; ++i) {
+        NPlaylistWidgetItem *item = itemAtRow(i);
+        if (needsRefresh(item, titleFormat)) {
+            int id = item->data(N::IdRole).toInt();
+            visible << qMakePair(id, item->data(N::PathRole).toString());
+            visibleIds << id;
+        }
+    }
+
+    QList<QPair<int, QString>> rest;
+    if (all) {
+        for (int i = 0; i < count(); ++i) {
+            NPlaylistWidgetItem *item = itemAtRow(i);
+            if ((i < minRow || i > maxRow) && needsRefresh(item, titleFormat)) {
+                rest << qMakePair(item->data(N::IdRole).toInt(),
+                                  item->data(N::PathRole).toString());
+            }
+        }
+    }
+
+    QMutexLocker locker(&m_resolveMutex);
+    m_resolveEncoding = NSettings::instance()->value("EncodingTrackInfo").toString();
+    m_resolveTags = m_trackInfoReader->cachedTags();
+    if (all) {
+        m_resolveRest = rest;
+    } else {
+        // rows scrolled out of view go back to the rest, rows scrolled into view leave it:
+        QList<QPair<int, QString>> remaining;
+        QList<QPair<int, QString>> previous = m_resolveVisible + m_resolveRest;
+        for (int i = 0; i < previous.size(); ++i) {
+            if (!visibleIds.contains(previous.at(i).first)) {
+                remaining << previous.at(i);
+            }
+        }
+        m_resolveRest = remaining;
+    }
+    m_resolveVisible = visible;
+
+    if (!m_resolveRunning && !(m_resolveVisible.isEmpty() && m_resolveRest.isEmpty())) {
+        m_resolveRunning = true;
+        m_resolvePool.start(new NPlaylistResolveWorker(this));
+    }
+}
+
+void NPlaylistWidget::resolveRun()
+{
+    forever {
+        QList<int> ids;
+        QStringList files;
+        QString tags;
+        QString encoding;
+        {
+            QMutexLocker locker(&m_resolveMutex);
+            if (m_resolveCancelled || (m_resolveVisible.isEmpty() && m_resolveRest.isEmpty())) {
+                m_resolveRunning = false;
+                return;
+            }
+            QList<QPair<int, QString>> &queue = m_resolveVisible.isEmpty() ? m_resolveRest
+                                                                            : m_resolveVisible;
+            while (!queue.isEmpty() && files.size() < RESOLVE_BATCH) {
+                QPair<int, QString> entry = queue.takeFirst();
+                ids << entry.first;
+                files << entry.second;
+            }
+            tags = m_resolveTags;
+            encoding = m_resolveEncoding;
+        }
+
+        QList<NTagData> results = m_trackInfoReader->readMany(files, tags, encoding);
+
+        QMutexLocker locker(&m_resolveMutex);
+        if (m_resolveCancelled) {
+            continue;
+        }
+        bool posted = !m_resolved.isEmpty(); // the GUI thread hasn't picked up the last batch
+        for (int i = 0; i < results.size(); ++i) {
+            m_resolved << qMakePair(ids.at(i), results.at(i));
+        }
+        if (!posted) {
+            QMetaObject::invokeMethod(this, "applyResolved", Qt::QueuedConnection);
+        }
+    }
+}
+
+void NPlaylistWidget::applyResolved()
+{
+    QList<QPair<int, NTagData>> resolved;
+    {
+        QMutexLocker locker(&m_resolveMutex);
+        resolved.swap(m_resolved);
+    }
+    if (!m_trackInfoReader || resolved.isEmpty()) {
+        return;
+    }
+
+    bool changed = false;
+    QString titleFormat = NSettings::instance()->value("PlaylistTrackInfo").toString();
+    for (int i = 0; i < resolved.size(); ++i) {
+        NPlaylistWidgetItem *item = m_itemMap.value(resolved.at(i).first);
+        if (!item) { // removed meanwhile
+            continue;
+        }
+        m_trackInfoReader->setSource(resolved.at(i).second);
+        int seconds = m_trackInfoReader->toString("%D").toInt();
+        m_durationSec += qMax(0, seconds) - qMax(0, item->data(N::DurationRole).toInt());
+        item->setText(m_trackInfoReader->toString(titleFormat));
+        item->setData(N::DurationRole, seconds);
+        item->setData(N::TitleFormatRole, titleFormat);
+        changed = true;
+    }
+    if (!changed) {
+        return;
+    }
+
+    // the reader is shared with the track info of the playing item:
+    if (m_playingItem) {
+        m_trackInfoReader->setSource(m_playingItem->data(N::PathRole).toString());
+    }
+    if (!m_resolvedTimer->isActive()) {
+        m_resolvedTimer->start();
+    }
+}
+
+void NPlaylistWidget::resolveStop()
+{
+    {
+        QMutexLocker locker(&m_resolveMutex);
+        m_resolveCancelled = true;
+        m_resolveVisible.clear();
+        m_resolveRest.clear();
+    }
+    m_resolvePool.waitForDone();
+
+    QMutexLocker locker(&m_resolveMutex);
+    m_resolved.clear();
+    m_resolveCancelled = false;
+}
+
+void NPlaylistWidget::precomputeWaveforms()
+{
+    if (!m_waveformBuilder || count() == 0) {
+        return;
+    }
+
+    // upcoming items first, then the visible ones:
+    QStringList files;
+    NPlaylistWidgetItem *item = m_playingItem;
+    for (int i = 0; i < PRECOMPUTE_AHEAD && (item = nextItem(item)); ++i) {
+        files << item->data(N::PathRole).toString();
+    }
+
+    int minRow = qMax(0, row(itemAt(0, 0)));
+    QListWidgetItem *maxItem = itemAt(0, this->height());
+    int maxRow = maxItem ? row(maxItem) : count() - 1;
+    for (int i = minRow; i <= maxRow; ++i) {
+        files << itemAtRow(i)->data(N::PathRole).toString();
+    }
+
+    m_waveformBuilder->precompute(files);
 }
 
 void NPlaylistWidget::wheelEvent(QWheelEvent *event)
@@ -206,6 +437,7 @@ void NPlaylistWidget::on_trashAction_triggered()
             continue;
         }
 
+        m_itemMap.remove(item->data(N::IdRole).toInt());
         delete takeItem(row(item));
     }
 
@@ -361,6 +593,7 @@ void NPlaylistWidget::calculateDuration()
         }
     }
 
+    m_durationSec = secondsTotal;
     emit durationChanged(secondsTotal);
 }
 
@@ -371,7 +604,10 @@ void NPlaylistWidget::updateTrackIndexes()
     }
 }
 
-NPlaylistWidget::~NPlaylistWidget() {}
+NPlaylistWidget::~NPlaylistWidget()
+{
+    resolveStop();
+}
 
 void NPlaylistWidget::resetPlayingItem()
 {
@@ -381,10 +617,15 @@ void NPlaylistWidget::resetPlayingItem()
     m_playingItem = NULL;
 }
 
+bool NPlaylistWidget::needsRefresh(NPlaylistWidgetItem *item, const QString &titleFormat) const
+{
+    return titleFormat != item->data(N::TitleFormatRole).toString() || item->text().isEmpty() ||
+           item->data(N::DurationRole).toInt() == -1;
+}
+
 bool NPlaylistWidget::refreshItemData(NPlaylistWidgetItem *item, QString titleFormat, bool force)
 {
-    if (!force && titleFormat == item->data(N::TitleFormatRole).toString() &&
-        !item->text().isEmpty() && item->data(N::DurationRole).toInt() != -1) {
+    if (!force && !needsRefresh(item, titleFormat)) {
         return false;
     }
 
@@ -414,6 +655,8 @@ void NPlaylistWidget::setPlayingItem(NPlaylistWidgetItem *item)
     m_playingItem = item;
     emit playingItemChanged();
     QListWidget::viewport()->update();
+
+    precomputeWaveforms();
 }
 
 void NPlaylistWidget::on_playbackEngine_mediaChanged(const QString &file, int id)
@@ -539,7 +782,7 @@ void NPlaylistWidget::addFiles(const QStringList &files)
     foreach (QString path, files)
         addItem(new NPlaylistWidgetItem(QFileInfo(path)));
 
-    processVisibleItems();
+    processItems();
     calculateDuration();
     updateTrackIndexes();
     emit itemsChanged();
@@ -550,7 +793,7 @@ void NPlaylistWidget::addItems(const QList<NPlaylistDataItem> &dataItems)
     foreach (NPlaylistDataItem dataItem, dataItems)
         addItem(new NPlaylistWidgetItem(dataItem));
 
-    processVisibleItems();
+    processItems();
     calculateDuration();
     updateTrackIndexes();
     emit itemsChanged();
@@ -559,11 +802,12 @@ void NPlaylistWidget::addItems(const QList<NPlaylistDataItem> &dataItems)
 void NPlaylistWidget::setFiles(const QStringList &files)
 {
     clear();
+    m_itemMap.clear();
     m_playingItem = NULL;
     foreach (QString path, files)
         addItem(new NPlaylistWidgetItem(QFileInfo(path)));
 
-    processVisibleItems();
+    processItems();
     calculateDuration();
     updateTrackIndexes();
     emit itemsChanged();
@@ -572,12 +816,13 @@ void NPlaylistWidget::setFiles(const QStringList &files)
 void NPlaylistWidget::setItems(const QList<NPlaylistDataItem> &dataItems)
 {
     clear();
+    m_itemMap.clear();
     m_playingItem = NULL;
 
     foreach (NPlaylistDataItem dataItem, dataItems)
         addItem(new NPlaylistWidgetItem(dataItem));
 
-    processVisibleItems();
+    processItems();
     calculateDuration();
     updateTrackIndexes();
     emit itemsChanged();
@@ -586,6 +831,7 @@ void NPlaylistWidget::setItems(const QList<NPlaylistDataItem> &dataItems)
 bool NPlaylistWidget::setPlaylist(const QString &file)
 {
     clear();
+    m_itemMap.clear();
     m_playingItem = NULL;
 
     QList<NPlaylistDataItem> dataItemsList = NPlaylistStorage::readM3u(file);
@@ -600,7 +846,7 @@ bool NPlaylistWidget::setPlaylist(const QString &file)
         addItem(new NPlaylistWidgetItem(dataItemsList.at(i)));
     }
 
-    processVisibleItems();
+    processItems();
     calculateDuration();
     updateTrackIndexes();
     emit itemsChanged();
@@ -786,7 +1032,7 @@ bool NPlaylistWidget::dropMimeData(int index, const QMimeData *data, Qt::DropAct
 
     m_itemDrag = NULL;
 
-    processVisibleItems();
+    processItems();
     calculateDuration();
     updateTrackIndexes();
     emit itemsChanged();
@@ -18,14 +18,19 @@
 
 #include <QList>
 #include <QListWidget>
+#include <QMutex>
+#include <QPair>
 #include <QPointer>
+#include <QThreadPool>
 
 #include "global.h"
+#include "tagReaderInterface.h"
 
 class NPlaylistDataItem;
 class NPlaylistWidgetItem;
 class NTrackInfoReader;
 class NPlaybackEngineInterface;
+class NWaveformBuilderInterface;
 class QContextMenuEvent;
 class QDropEvent;
 class QMenu;
@@ -47,17 +52,37 @@ private:
     QMenu *m_contextMenu;
     NTrackInfoReader *m_trackInfoReader;
     NPlaybackEngineInterface *m_playbackEngine;
+    NWaveformBuilderInterface *m_waveformBuilder;
     QTimer *m_processVisibleItemsTimer;
     bool m_repeatMode;
 
+    // background tag resolution, visible rows first, then the rest of the playlist:
+    QThreadPool m_resolvePool;
+    QMutex m_resolveMutex;
+    QList<QPair<int, QString>> m_resolveVisible; // item id, path
+    QList<QPair<int, QString>> m_resolveRest;
+    QList<QPair<int, NTagData>> m_resolved; // waiting for the GUI thread
+    QString m_resolveEncoding;
+    QString m_resolveTags;
+    bool m_resolveRunning;
+    bool m_resolveCancelled;
+    QTimer *m_resolvedTimer; // notifies of resolved rows at most this often
+    int m_durationSec;       // of the whole playlist
+
     void addItem(NPlaylistWidgetItem *item);
     void paintEvent(QPaintEvent *event);
     void contextMenuEvent(QContextMenuEvent *event);
     void resizeEvent(QResizeEvent *event);
     bool refreshItemData(NPlaylistWidgetItem *item, QString titleFormat, bool force = false);
+    bool needsRefresh(NPlaylistWidgetItem *item, const QString &titleFormat) const;
+    void visibleRows(int &minRow, int &maxRow) const;
+    void processItems();
+    void resolveItems(bool all);
+    void resolveStop();
     NPlaylistWidgetItem *nextItem(NPlaylistWidgetItem *) const;
     NPlaylistWidgetItem *prevItem(NPlaylistWidgetItem *item) const;
     void resetPlayingItem();
+    void precomputeWaveforms();
     bool revealInFileManager(const QString &file, QString *error) const;
 
 protected:
@@ -72,6 +97,7 @@ private slots:
     void on_revealAction_triggered();
     void on_tagEditorAction_triggered();
     void startProcessVisibleItemsTimer();
+    void applyResolved();
 
     void on_playbackEngine_mediaChanged(const QString &file, int id);
     void on_playbackEngine_prepareNextMediaRequested();
@@ -89,6 +115,7 @@ public:
     Q_INVOKABLE bool repeatMode() const;
 
     void setTrackInfoReader(NTrackInfoReader *reader);
+    void resolveRun(); // worker thread
 
 public slots:
     void playRow(int row);
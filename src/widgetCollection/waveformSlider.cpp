@@ -20,6 +20,7 @@
 #include <QPainterPath>
 #include <QStyleOptionFocusRect>
 #include <QStylePainter>
+#include <QtMath>
 
 #include "playlistDataItem.h"
 #include "pluginLoader.h"
@@ -27,8 +28,9 @@
 #include "utils.h"
 #include "waveformBuilderInterface.h"
 
-#define IDLE_INTERVAL 60
-#define FAST_INTERVAL 10
+#define UPDATE_INTERVAL 10
+#define ZOOM_STEP 1.25
+#define SCROLL_STEP 0.1
 
 NWaveformSlider::NWaveformSlider(QWidget *parent) : QAbstractSlider(parent)
 {
@@ -54,11 +56,15 @@ NWaveformSlider::NWaveformSlider(QWidget *parent) : QAbstractSlider(parent)
     m_waveBuilder = dynamic_cast<NWaveformBuilderInterface *>(
         NPluginLoader::getPlugin(N::WaveformBuilder));
     Q_ASSERT(m_waveBuilder);
+    loadSettings();
 
+    // redrawn on notifications from the builder only, coalesced by the timer:
+    connect(m_waveBuilder, SIGNAL(peaksAdvanced()), this, SLOT(scheduleUpdate()));
+    connect(m_waveBuilder, SIGNAL(peaksCompleted()), this, SLOT(checkForUpdate()));
     m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(UPDATE_INTERVAL);
     connect(m_timer, SIGNAL(timeout()), this, SLOT(checkForUpdate()));
-    m_timer->setInterval(IDLE_INTERVAL);
-    m_timer->start();
 
     setAcceptDrops(true);
     setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Expanding);
@@ -69,6 +75,14 @@ NWaveformSlider::NWaveformSlider(QWidget *parent) : QAbstractSlider(parent)
     init();
 }
 
+void NWaveformSlider::loadSettings()
+{
+    m_waveBuilder->setSharedDecode(NSettings::instance()->value("WaveformSharedDecode").toBool());
+    m_waveBuilder->setCacheBudget(
+        NSettings::instance()->value("WaveformCacheMemoryMB").toLongLong() * 1024 * 1024,
+        NSettings::instance()->value("WaveformCacheDiskMB").toLongLong() * 1024 * 1024);
+}
+
 void NWaveformSlider::setPausedState(bool state)
 {
     m_pausedState = state;
@@ -80,8 +94,13 @@ void NWaveformSlider::init()
     m_oldBuilderIndex = -1;
     m_oldBuilderPos = -1;
     m_pausedState = false;
-    m_needsUpdate = false;
+    m_needsUpdate = true;
     m_hasMedia = false;
+    m_zoom = 1.0;
+    m_offset = 0.0;
+    m_columnsDone = 0;
+    m_compositePaused = false;
+    m_compositeX = 0.0;
 }
 
 QSize NWaveformSlider::sizeHint() const
@@ -107,91 +126,169 @@ void NWaveformSlider::checkForUpdate()
     int builderIndex;
     m_waveBuilder->positionAndIndex(builderPos, builderIndex);
 
-    if (m_oldSize != size() || m_oldBuilderIndex != builderIndex) {
+    // restarted, or completed and to be drawn exactly once more:
+    if (m_oldSize != size() || builderIndex < m_oldBuilderIndex ||
+        (builderPos == 1.0 && m_oldBuilderPos != 1.0)) {
         m_needsUpdate = true;
     }
 
-    if ((builderPos != 0.0 && builderPos != 1.0) && m_timer->interval() != FAST_INTERVAL) {
-        m_timer->setInterval(FAST_INTERVAL);
-    } else if ((builderPos == 0.0 || builderPos == 1.0) && m_timer->interval() != IDLE_INTERVAL) {
-        m_timer->setInterval(IDLE_INTERVAL);
-    }
-
     if (m_needsUpdate) {
-        QPainter painter;
         qreal dpr = devicePixelRatioF();
         QImage image(width() * dpr, height() * dpr, QImage::Format_ARGB32_Premultiplied);
         image.setDevicePixelRatio(dpr);
-        QImage waveImage;
-        waveImage = m_backgroundImage = m_progressPlayingImage = m_progressPausedImage =
-            m_remainingPlayingImage = m_remainingPausedImage = image;
+        image.fill(0);
+        m_waveImage = m_compositeImage = image;
+        m_compositePaused = m_pausedState;
+        m_compositeX = progressX();
 
         m_oldBuilderPos = builderPos;
         m_oldBuilderIndex = builderIndex;
         m_oldSize = size();
+        m_columns.clear();
+        m_columnsDone = 0;
 
-        // waveform >>
-        waveImage.fill(0);
-        painter.begin(&waveImage);
-        painter.setBrush(m_waveBackground);
-        QPen wavePen;
-        wavePen.setWidth(0);
-        wavePen.setColor(m_waveBorderColor);
-        painter.setPen(wavePen);
-
-        QPainterPath pathPos;
-        QPainterPath pathNeg;
-        const NWaveformPeaks &peaks = m_waveBuilder->peaks();
-        for (int i = 0; i < m_oldBuilderIndex; ++i) {
-            pathPos.lineTo((i / (qreal)m_oldBuilderIndex) * m_oldBuilderPos * width(),
-                           (1 + peaks.positive(i)) * (height() / 2.0));
-            pathNeg.lineTo((i / (qreal)m_oldBuilderIndex) * m_oldBuilderPos * width(),
-                           (1 + peaks.negative(i)) * (height() / 2.0));
+        renderColumns();
+        composite(rect());
+        update();
+        m_needsUpdate = false;
+    } else if (m_oldBuilderIndex != builderIndex) {
+        m_oldBuilderPos = builderPos;
+        m_oldBuilderIndex = builderIndex;
+        QRectF strip = renderColumns();
+        if (!strip.isEmpty()) {
+            composite(strip);
+            update(strip.toAlignedRect());
         }
-        QPainterPath fullPath(pathNeg);
-        fullPath.connectPath(pathPos.toReversed());
-        fullPath.closeSubpath();
-        painter.setRenderHint(QPainter::Antialiasing);
-        painter.drawPath(fullPath);
-        painter.end();
-        // << waveform
+    }
+}
 
-        // main background >>
-        painter.begin(&m_backgroundImage);
-        m_backgroundImage.fill(0);
-        painter.setPen(Qt::NoPen);
-        painter.setBrush(m_background);
-        painter.setRenderHint(QPainter::Antialiasing);
-        painter.drawRoundedRect(rect(), m_radius, m_radius);
-        painter.end();
-        // << main background
-
-        QList<QImage *> images;
-        images << &m_progressPlayingImage << &m_progressPausedImage << &m_remainingPlayingImage
-               << &m_remainingPausedImage;
-        QList<QPainter::CompositionMode> modes;
-        modes << m_playingComposition << m_pausedComposition << m_playingComposition
-              << m_pausedComposition;
-        QList<QBrush> brushes;
-        brushes << m_progressPlayingBackground << m_progressPausedBackground
-                << m_remainingPlayingBackground << m_remainingPausedBackground;
-        for (int i = 0; i < images.size(); ++i) {
-            painter.begin(images[i]);
-            images[i]->fill(0);
-            painter.setPen(Qt::NoPen);
-            painter.setBrush(brushes[i]);
-            painter.setRenderHint(QPainter::Antialiasing);
-            painter.drawRect(rect());
-            painter.setCompositionMode(modes[i]);
-            painter.drawImage(0, 0, waveImage);
-            painter.setCompositionMode(QPainter::CompositionMode_DestinationAtop);
-            painter.drawImage(0, 0, m_backgroundImage);
-            painter.end();
+void NWaveformSlider::scheduleUpdate()
+{
+    if (!m_timer->isActive()) {
+        m_timer->start();
+    }
+}
+
+QRectF NWaveformSlider::renderColumns()
+{
+    int first = m_columnsDone;
+    m_columns.resize(m_columnsDone);
+
+    // one point per pixel column of the visible part of the track, columns that are
+    // not yet fully decoded get resampled the next time:
+    const NWaveformPeaks &peaks = m_waveBuilder->peaks();
+    if (m_oldBuilderIndex > 0) {
+        int columns = width();
+        qreal span = 1.0 / m_zoom;
+        for (int i = m_columns.size(); i <= columns; ++i) {
+            qreal from = m_offset + span * i / columns;
+            if (from >= m_oldBuilderPos) {
+                break;
+            }
+            qreal to = from + span / columns;
+            qreal positive;
+            qreal negative;
+            peaks.range(from / m_oldBuilderPos, qMin(to, (qreal)m_oldBuilderPos) / m_oldBuilderPos,
+                        positive, negative);
+            m_columns << qMakePair(positive, negative);
+            if (to <= m_oldBuilderPos || m_oldBuilderPos == 1.0) {
+                m_columnsDone = m_columns.size();
+            }
         }
+    }
 
-        update();
-        m_needsUpdate = false;
+    int last = m_columns.size() - 1;
+    if (last < first) {
+        return QRectF();
+    }
+
+    // repaint from the column before the first changed one, the path starts one
+    // more column earlier, so that the outline joins the already painted part:
+    QRectF strip(first - 1, 0, last - first + 3, height());
+    int start = qMax(0, first - 2);
+    qreal middle = height() / 2.0;
+    QPainterPath path;
+    path.moveTo(start, (1 + m_columns.at(start).second) * middle);
+    for (int i = start + 1; i <= last; ++i) {
+        path.lineTo(i, (1 + m_columns.at(i).second) * middle);
+    }
+    for (int i = last; i >= start; --i) {
+        path.lineTo(i, (1 + m_columns.at(i).first) * middle);
     }
+    path.closeSubpath();
+
+    QPainter painter;
+
+    // waveform >>
+    painter.begin(&m_waveImage);
+    painter.setClipRect(strip);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.fillRect(strip, Qt::transparent);
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter.setBrush(m_waveBackground);
+    QPen wavePen;
+    wavePen.setWidth(0);
+    wavePen.setColor(m_waveBorderColor);
+    painter.setPen(wavePen);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.drawPath(path);
+    painter.end();
+    // << waveform
+
+    return strip;
+}
+
+qreal NWaveformSlider::progressX() const
+{
+    qreal x = ((qreal)value() / maximum() - m_offset) * m_zoom * width();
+    return qBound(0.0, x, (qreal)width());
+}
+
+void NWaveformSlider::composite(const QRectF &region)
+{
+    if (m_compositeImage.isNull()) {
+        return;
+    }
+
+    // only the brushes of the current state, progress on the left, remaining on the right:
+    QRectF parts[2];
+    parts[0] = QRectF(0, 0, m_compositeX, height()) & region;
+    parts[1] = QRectF(m_compositeX, 0, width() - m_compositeX, height()) & region;
+    QBrush brushes[2];
+    brushes[0] = m_compositePaused ? m_progressPausedBackground : m_progressPlayingBackground;
+    brushes[1] = m_compositePaused ? m_remainingPausedBackground : m_remainingPlayingBackground;
+    QPainter::CompositionMode mode = m_compositePaused ? m_pausedComposition
+                                                       : m_playingComposition;
+
+    QPainter painter(&m_compositeImage);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(Qt::NoPen);
+    for (int i = 0; i < 2; ++i) {
+        if (parts[i].isEmpty()) {
+            continue;
+        }
+        painter.setClipRect(parts[i]);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.fillRect(parts[i], Qt::transparent);
+        painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+        painter.setBrush(brushes[i]);
+        painter.drawRect(rect());
+        painter.setCompositionMode(mode);
+        painter.drawImage(0, 0, m_waveImage);
+    }
+
+    // main background behind, nothing outside of its rounded corners:
+    QPainterPath background;
+    background.addRoundedRect(rect(), m_radius, m_radius);
+    QPainterPath outside;
+    outside.addRect(rect());
+    outside -= background;
+    painter.setClipRect(region);
+    painter.setBrush(m_background);
+    painter.setCompositionMode(QPainter::CompositionMode_DestinationAtop);
+    painter.drawPath(background);
+    painter.setCompositionMode(QPainter::CompositionMode_Clear);
+    painter.drawPath(outside);
 }
 
 void NWaveformSlider::paintEvent(QPaintEvent *)
@@ -199,18 +296,19 @@ void NWaveformSlider::paintEvent(QPaintEvent *)
     QPainter painter(this);
 
     if (m_hasMedia) {
-        qreal x = (qreal)value() / maximum() * width();
-        qreal dpr = devicePixelRatioF();
-        QTransform transform;
-        transform.scale(dpr, dpr);
-
-        QRectF left = QRectF(0, 0, x, height());
-        painter.drawImage(left, m_pausedState ? m_progressPausedImage : m_progressPlayingImage,
-                          transform.mapRect(left));
-
-        QRectF right = QRectF(x, 0, width() - x, height());
-        painter.drawImage(right, m_pausedState ? m_remainingPausedImage : m_remainingPlayingImage,
-                          transform.mapRect(right));
+        // recomposite what the state change or the moved progress affects:
+        qreal x = progressX();
+        if (m_compositePaused != m_pausedState) {
+            m_compositePaused = m_pausedState;
+            m_compositeX = x;
+            composite(rect());
+        } else if (m_compositeX != x) {
+            qreal from = qMin(x, m_compositeX);
+            qreal to = qMax(x, m_compositeX);
+            m_compositeX = x;
+            composite(QRectF(from - 1, 0, to - from + 2, height()));
+        }
+        painter.drawImage(QPointF(0, 0), m_compositeImage);
 
         QColor grooveColor = m_pausedState ? m_groovePausedColor : m_groovePlayingColor;
         if (grooveColor != Qt::transparent) {
@@ -239,7 +337,7 @@ void NWaveformSlider::mousePressEvent(QMouseEvent *event)
         return;
     }
 
-    qreal value = (qreal)event->x() / width();
+    qreal value = m_offset + (qreal)event->x() / width() / m_zoom;
 
     emit sliderMoved(value);
     setValue(value);
@@ -247,13 +345,36 @@ void NWaveformSlider::mousePressEvent(QMouseEvent *event)
 
 void NWaveformSlider::wheelEvent(QWheelEvent *event)
 {
-    event->ignore();
+    // plain wheel is handled by the main window (volume control)
+    int delta = event->angleDelta().y();
+    if (!m_hasMedia || delta == 0 ||
+        !(event->modifiers() & (Qt::ControlModifier | Qt::ShiftModifier))) {
+        event->ignore();
+        return;
+    }
+
+    qreal x = (qreal)event->pos().x() / width();
+    if (event->modifiers() & Qt::ControlModifier) { // zoom around the cursor
+        // pixel-exact: one finest peaks bin per pixel column
+        qreal maxZoom = qMax(1.0, (qreal)m_waveBuilder->peaks().size(0) / width());
+        qreal anchor = m_offset + x / m_zoom;
+        m_zoom = qBound(1.0, m_zoom * (delta > 0 ? ZOOM_STEP : 1 / ZOOM_STEP), maxZoom);
+        m_offset = anchor - x / m_zoom;
+    } else { // scroll
+        m_offset -= (delta / 120.0) * SCROLL_STEP / m_zoom;
+    }
+    m_offset = qBound(0.0, m_offset, 1.0 - 1.0 / m_zoom);
+
+    m_needsUpdate = true;
+    checkForUpdate();
+    event->accept();
 }
 
 void NWaveformSlider::changeEvent(QEvent *event)
 {
     if (event->type() == QEvent::StyleChange) {
         m_needsUpdate = true;
+        scheduleUpdate();
     }
     QWidget::changeEvent(event);
 }
@@ -261,12 +382,21 @@ void NWaveformSlider::changeEvent(QEvent *event)
 void NWaveformSlider::setValue(qreal value)
 {
     QAbstractSlider::setValue(value * maximum());
+
+    // keep the playing position within the zoomed view:
+    if (m_zoom > 1.0 && (value < m_offset || value >= m_offset + 1.0 / m_zoom)) {
+        m_offset = qBound(0.0, value, 1.0 - 1.0 / m_zoom);
+        m_needsUpdate = true;
+        scheduleUpdate();
+    }
 }
 
 void NWaveformSlider::setMedia(const QString &file)
 {
     init();
 
+    scheduleUpdate();
+
     if (file.isEmpty() || !QFile(file).exists()) {
         m_hasMedia = false;
         return;
@@ -18,6 +18,7 @@
 
 #include <QAbstractSlider>
 #include <QPainter>
+#include <QPair>
 #include <QVector>
 
 class NPlaylistDataItem;
@@ -45,11 +46,10 @@ class NWaveformSlider : public QAbstractSlider
 
 private:
     NWaveformBuilderInterface *m_waveBuilder;
-    QImage m_backgroundImage;
-    QImage m_progressPlayingImage;
-    QImage m_progressPausedImage;
-    QImage m_remainingPlayingImage;
-    QImage m_remainingPausedImage;
+    QImage m_waveImage;
+    QImage m_compositeImage; // for m_compositePaused, split at m_compositeX
+    bool m_compositePaused;
+    qreal m_compositeX;
     QTimer *m_timer;
     bool m_pausedState;
     QSize m_oldSize;
@@ -57,6 +57,10 @@ private:
     float m_oldBuilderPos;
     bool m_hasMedia;
     bool m_needsUpdate;
+    qreal m_zoom;
+    qreal m_offset;
+    QVector<QPair<qreal, qreal>> m_columns; // positive and negative peak of each pixel column
+    int m_columnsDone;                      // columns, which won't change anymore
 
     void mousePressEvent(QMouseEvent *event);
     void wheelEvent(QWheelEvent *event);
@@ -64,6 +68,9 @@ private:
     void resizeEvent(QResizeEvent *event);
     void changeEvent(QEvent *event);
     void init();
+    QRectF renderColumns();
+    qreal progressX() const;
+    void composite(const QRectF &region);
 
 public:
     NWaveformSlider(QWidget *parent = 0);
@@ -71,12 +78,14 @@ public:
     QSize sizeHint() const;
 
 public slots:
+    void loadSettings();
     void setMedia(const QString &file);
     void setPausedState(bool);
     void setValue(qreal value);
 
 private slots:
     void checkForUpdate();
+    void scheduleUpdate();
     void setValue(int){};
 
 signals:
@@ -0,0 +1,66 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#ifndef N_PLAYBACK_ENGINE_TEST_H
+#define N_PLAYBACK_ENGINE_TEST_H
+
+#include <QtTest/QtTest>
+
+#include "playbackEngineInterface.h"
+#include "pluginLoader.h"
+#include "settings.h"
+
+// Base of the tests measuring the GStreamer engine on the null sinks of a tests build.
+class NPlaybackEngineTest : public QObject
+{
+    Q_OBJECT
+
+protected:
+    NPlaybackEngineInterface *m_playbackEngine{};
+
+    // empty once the engine is loaded and the fixtures are found, the reason to skip otherwise:
+    QString initPlaybackEngine(const char *hook, const QStringList &fixtures)
+    {
+        NSettings::instance()->clear();
+        NSettings::instance()->setValue("Plugins/PlaybackEngine", "GStreamer");
+        NPluginLoader::init();
+
+        m_playbackEngine = dynamic_cast<NPlaybackEngineInterface *>(
+            NPluginLoader::getPlugin(N::PlaybackEngine));
+        Q_ASSERT(m_playbackEngine);
+        if (m_playbackEngine->metaObject()->indexOfMethod(hook) == -1) {
+            return "Playback engine has no null sinks to measure";
+        }
+
+        connect(m_playbackEngine, SIGNAL(message(N::MessageIcon, const QString &, const QString &)),
+                this, SLOT(message(N::MessageIcon, const QString &, const QString &)));
+
+        QDir::setCurrent("tests");
+        foreach (QString fixture, fixtures) {
+            if (!QFileInfo(fixture).isFile()) {
+                return fixture + " is missing, gst-launch-1.0 generates it when building";
+            }
+        }
+        return QString();
+    }
+
+protected slots:
+    void message(N::MessageIcon, const QString &, const QString &msg)
+    {
+        QFAIL(msg.toUtf8().constData());
+    }
+};
+
+#endif
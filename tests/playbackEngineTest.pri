@@ -0,0 +1,14 @@
+HEADERS += playbackEngineTest.h
+
+# audio fixtures are generated with gst-launch-1.0, the tests skip without them:
+win32: GST_LAUNCH = $$system(where gst-launch-1.0 2> NUL)
+else: GST_LAUNCH = $$system(command -v gst-launch-1.0)
+isEmpty(GST_LAUNCH): message("gst-launch-1.0 not found, $$TARGET will be skipped")
+
+# gstFixture(file, pipeline): writes the output of the pipeline to the file
+defineTest(gstFixture) {
+    isEmpty(GST_LAUNCH): return(false)
+    system(gst-launch-1.0 $$2 ! filesink location=$$1): return(true)
+    message("cannot generate $$1")
+    return(false)
+}
@@ -0,0 +1,144 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#include <QSignalSpy>
+#include <QtTest/QtTest>
+
+#include "playbackEngineTest.h"
+
+#define NSEC_IN_SEC 1000000000.0
+#define TRACK_MSEC 4000 // samples are 4 seconds
+#define GAPLESS_TOLERANCE_SAMPLES 1
+#define CROSSFADE_TOLERANCE_MSEC 5
+#define FINISH_TIMEOUT_MSEC 20000
+
+// Plays two samples in a row on the null sinks of a tests build and measures, in samples,
+// where the second one starts against where the first one ends.
+class TestCrossfade : public NPlaybackEngineTest
+{
+    Q_OBJECT
+
+    int m_requests{};
+
+    QVariantList renderedSpans()
+    {
+        QVariantList spans;
+        QMetaObject::invokeMethod(m_playbackEngine, "_renderedSpans",
+                                  Q_RETURN_ARG(QVariantList, spans));
+        return spans;
+    }
+
+    QVariantList playTransition(qint64 crossfadeMsec)
+    {
+        m_playbackEngine->setCrossfadeMsec(crossfadeMsec);
+        m_requests = 0;
+        int before = renderedSpans().size();
+
+        QSignalSpy spy(m_playbackEngine, SIGNAL(mediaFinished(const QString &, int)));
+        m_playbackEngine->setMedia(QFileInfo("crossfade_a.wav").absoluteFilePath(), 1);
+        m_playbackEngine->play();
+        if (!spy.wait(FINISH_TIMEOUT_MSEC)) {
+            return QVariantList();
+        }
+        if (spy.first().at(1).toInt() != 2) { // finished before the transition
+            return QVariantList();
+        }
+        return renderedSpans().mid(before);
+    }
+
+    static qint64 samples(qint64 nsec, int rate) { return qRound64(nsec * rate / NSEC_IN_SEC); }
+
+    static void verifyWhole(const QVariantMap &span)
+    {
+        int rate = span["rate"].toInt();
+        qint64 length = samples(span["end"].toLongLong() - span["start"].toLongLong(), rate);
+        qint64 expected = (qint64)TRACK_MSEC * rate / 1000;
+        QVERIFY2(qAbs(length - expected) <= GAPLESS_TOLERANCE_SAMPLES,
+                 qPrintable(QString("%1 samples played of %2").arg(length).arg(expected)));
+    }
+
+private slots:
+    void initTestCase()
+    {
+        QStringList fixtures = QStringList() << "crossfade_a.wav"
+                                             << "crossfade_b.wav";
+        QString skip = initPlaybackEngine("_renderedSpans()", fixtures);
+        if (!skip.isEmpty()) {
+            QSKIP(qPrintable(skip));
+        }
+
+        connect(m_playbackEngine, SIGNAL(nextMediaRequested()), this, SLOT(nextMediaRequested()));
+    }
+
+    void cleanup()
+    {
+        m_playbackEngine->stop();
+        m_playbackEngine->setCrossfadeMsec(0);
+    }
+
+    void testGapless()
+    {
+        QVariantList spans = playTransition(0);
+        QCOMPARE(spans.size(), 2);
+        QVariantMap first = spans.at(0).toMap();
+        QVariantMap second = spans.at(1).toMap();
+        verifyWhole(first);
+        verifyWhole(second);
+
+        qint64 gap = samples(second["start"].toLongLong() - first["end"].toLongLong(),
+                             first["rate"].toInt());
+        QVERIFY2(qAbs(gap) <= GAPLESS_TOLERANCE_SAMPLES,
+                 qPrintable(QString("gap of %1 samples").arg(gap)));
+    }
+
+    void testCrossfade_data()
+    {
+        QTest::addColumn<int>("msec");
+        QTest::newRow("250 msec") << 250;
+        QTest::newRow("1 second") << 1000;
+    }
+
+    void testCrossfade()
+    {
+        QFETCH(int, msec);
+
+        QVariantList spans = playTransition(msec);
+        QCOMPARE(spans.size(), 2);
+        QVariantMap first = spans.at(0).toMap();
+        QVariantMap second = spans.at(1).toMap();
+        verifyWhole(first);
+        verifyWhole(second);
+
+        int rate = first["rate"].toInt();
+        qint64 overlap = samples(first["end"].toLongLong() - second["start"].toLongLong(), rate);
+        qint64 expected = (qint64)msec * rate / 1000;
+        QVERIFY2(qAbs(overlap - expected) <= (qint64)CROSSFADE_TOLERANCE_MSEC * rate / 1000,
+                 qPrintable(QString("overlap of %1 samples, expected %2")
+                                .arg(overlap)
+                                .arg(expected)));
+    }
+
+public slots:
+    void nextMediaRequested()
+    {
+        // only the first transition is measured, the second sample then finishes:
+        if (m_requests++ == 0) {
+            m_playbackEngine->nextMediaRespond(QFileInfo("crossfade_b.wav").absoluteFilePath(), 2);
+        }
+    }
+};
+
+QTEST_MAIN(TestCrossfade)
+#include "testCrossfade.moc"
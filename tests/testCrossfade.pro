@@ -0,0 +1,10 @@
+include(test.pri)
+include(playbackEngineTest.pri)
+QT += testlib
+
+TARGET = testCrossfade
+SOURCES += testCrossfade.cpp
+
+# 4 seconds samples of different pitch:
+gstFixture(crossfade_a.wav, audiotestsrc freq=440 samplesperbuffer=441 num-buffers=400 ! audioconvert ! wavenc)
+gstFixture(crossfade_b.wav, audiotestsrc freq=880 samplesperbuffer=441 num-buffers=400 ! audioconvert ! wavenc)
@@ -0,0 +1,142 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "pitchShifter.h"
+
+#define TONE_HZ 440.0
+#define FREQUENCY_TOLERANCE 0.01
+#define BENCHMARK_RATE 96000
+#define BENCHMARK_SECONDS 10
+
+class TestPitchShifter : public QObject
+{
+    Q_OBJECT
+
+private:
+    static QVector<float> tone(int rate, int channels, int frames)
+    {
+        QVector<float> samples(frames * channels);
+        for (int i = 0; i < frames; ++i) {
+            for (int j = 0; j < channels; ++j) {
+                samples[i * channels + j] = 0.5 * qSin(2 * M_PI * TONE_HZ * i / rate);
+            }
+        }
+        return samples;
+    }
+
+    // in blocks of random sizes, the way they come from the decoder:
+    static void process(NPitchShifter &shifter, QVector<float> &samples, int channels)
+    {
+        int frames = samples.size() / channels;
+        for (int i = 0; i < frames;) {
+            int count = qMin(qrand() % 4096 + 1, frames - i);
+            shifter.process(samples.data() + i * channels, count);
+            i += count;
+        }
+    }
+
+    static qreal frequency(const QVector<float> &samples, int channels, int from, int rate)
+    {
+        int crossings = 0;
+        int frames = samples.size() / channels;
+        for (int i = from + 1; i < frames; ++i) {
+            if ((samples[(i - 1) * channels] < 0) != (samples[i * channels] < 0)) {
+                ++crossings;
+            }
+        }
+        return crossings / 2.0 / ((qreal)(frames - from) / rate);
+    }
+
+private slots:
+    void initTestCase() { qsrand(1); }
+
+    void testPitch_data()
+    {
+        QTest::addColumn<int>("rate");
+        QTest::addColumn<qreal>("pitch");
+        QTest::newRow("44.1 kHz, octave down") << 44100 << 0.5;
+        QTest::newRow("44.1 kHz, 0.8") << 44100 << 0.8;
+        QTest::newRow("44.1 kHz, unchanged") << 44100 << 1.0;
+        QTest::newRow("48 kHz, 1.01") << 48000 << 1.01;
+        QTest::newRow("48 kHz, 1.25") << 48000 << 1.25;
+        QTest::newRow("96 kHz, octave up") << 96000 << 2.0;
+    }
+
+    void testPitch()
+    {
+        QFETCH(int, rate);
+        QFETCH(qreal, pitch);
+
+        NPitchShifter shifter;
+        shifter.setFormat(2, rate);
+        shifter.setPitch(pitch);
+        QVector<float> samples = tone(rate, 2, rate * 2);
+        process(shifter, samples, 2);
+
+        // past the delay, and the silence it was filled with:
+        qreal measured = frequency(samples, 2, shifter.latency() + rate / 10, rate);
+        QVERIFY2(qAbs(measured / (TONE_HZ * pitch) - 1.0) < FREQUENCY_TOLERANCE,
+                 qPrintable(QString("%1 Hz, expected %2 Hz").arg(measured).arg(TONE_HZ * pitch)));
+    }
+
+    void testLatency()
+    {
+        // the delay stays the same whatever the pitch does meanwhile:
+        NPitchShifter shifter;
+        shifter.setFormat(2, 44100);
+        QVector<float> samples(44100 * 2);
+        samples.fill(1.0f);
+        int frames = samples.size() / 2;
+        int silent = 0;
+        for (int i = 0; i < frames;) {
+            shifter.setPitch(0.5 + (qrand() % 151) / 100.0);
+            int count = qMin(qrand() % 4096 + 1, frames - i);
+            shifter.process(samples.data() + i * 2, count);
+            i += count;
+        }
+        while (silent < frames && samples[silent * 2] == 0.0f) {
+            ++silent;
+        }
+        QCOMPARE(silent, shifter.latency());
+        for (int i = silent; i < frames; ++i) {
+            QVERIFY2(samples[i * 2] != 0.0f, qPrintable(QString("ran dry at %1").arg(i)));
+        }
+    }
+
+    void benchmarkRealtime()
+    {
+        // stereo at 96 kHz, in blocks of the size sinks commonly ask for:
+        const int frames = BENCHMARK_RATE * BENCHMARK_SECONDS;
+        QVector<float> samples = tone(BENCHMARK_RATE, 2, frames);
+        NPitchShifter shifter;
+        shifter.setFormat(2, BENCHMARK_RATE);
+        shifter.setPitch(1.2);
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < frames; i += 1024) {
+            shifter.process(samples.data() + i * 2, qMin(1024, frames - i));
+        }
+
+        // per second of audio, real-time playback wants it well below 50 msec, 5% of a core:
+        QTest::setBenchmarkResult((qreal)timer.nsecsElapsed() / 1000000 / BENCHMARK_SECONDS,
+                                  QTest::WalltimeMilliseconds);
+    }
+};
+
+QTEST_MAIN(TestPitchShifter)
+#include "testPitchShifter.moc"
@@ -0,0 +1,6 @@
+include(test.pri)
+QT += testlib
+
+INCLUDEPATH += $$SRC_DIR/plugins
+TARGET = testPitchShifter
+SOURCES += testPitchShifter.cpp $$SRC_DIR/plugins/pitchShifter.cpp
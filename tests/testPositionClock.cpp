@@ -0,0 +1,147 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "positionClock.h"
+
+#define MSEC 1000000LL
+#define SEC 1000000000LL
+#define FRAME (16 * MSEC)
+
+class TestPositionClock : public QObject
+{
+    Q_OBJECT
+
+private:
+    // plays for a while at the given rate, against a pipeline whose clock runs at
+    // a slightly different speed and whose queries are off by a few milliseconds:
+    void play(NPositionClock &clock, qint64 &now, qint64 &truth, qreal rate, qreal skew,
+              qint64 duration, qint64 &maxDrift, bool &monotonic)
+    {
+        qint64 last = clock.position(now);
+        for (qint64 end = now + duration; now < end; now += FRAME) {
+            if (now % SEC < FRAME) {
+                qint64 jitter = (qrand() % 11 - 5) * MSEC;
+                clock.sample(truth + jitter, now);
+            }
+            qint64 position = clock.position(now);
+            maxDrift = qMax(maxDrift, qAbs(position - truth));
+            monotonic &= (position >= last);
+            last = position;
+            truth += (qint64)(FRAME * rate * skew);
+        }
+    }
+
+private slots:
+    void testExtrapolate()
+    {
+        NPositionClock clock;
+        QVERIFY(!clock.isValid());
+        QCOMPARE(clock.position(0), 0LL);
+
+        clock.setRate(1.0, 0);
+        clock.sample(10 * SEC, 0);
+        QVERIFY(clock.isValid());
+        QCOMPARE(clock.position(500 * MSEC), 10 * SEC + 500 * MSEC);
+
+        clock.setRate(2.0, 500 * MSEC);
+        QCOMPARE(clock.position(SEC), 11 * SEC + 500 * MSEC);
+
+        // paused:
+        clock.setRate(0.0, SEC);
+        QCOMPARE(clock.position(5 * SEC), 11 * SEC + 500 * MSEC);
+    }
+
+    void testSnap()
+    {
+        NPositionClock clock;
+        clock.setRate(1.0, 0);
+        clock.sample(0, 0);
+
+        // seeks are taken at once, both ways:
+        clock.sample(60 * SEC, SEC);
+        QCOMPARE(clock.position(SEC), 60 * SEC);
+        clock.sample(5 * SEC, 2 * SEC);
+        QCOMPARE(clock.position(2 * SEC), 5 * SEC);
+
+        // paused clocks follow the samples exactly:
+        clock.setRate(0.0, 2 * SEC);
+        clock.sample(5 * SEC - 20 * MSEC, 3 * SEC);
+        QCOMPARE(clock.position(4 * SEC), 5 * SEC - 20 * MSEC);
+    }
+
+    void testDrift_data()
+    {
+        QTest::addColumn<qreal>("rate");
+        QTest::addColumn<qreal>("skew");
+        QTest::newRow("normal") << 1.0 << 1.0;
+        QTest::newRow("fast device") << 1.0 << 1.003;
+        QTest::newRow("slow device") << 1.0 << 0.997;
+        QTest::newRow("double speed") << 2.0 << 1.002;
+        QTest::newRow("slow motion") << 0.25 << 0.998;
+    }
+
+    void testDrift()
+    {
+        QFETCH(qreal, rate);
+        QFETCH(qreal, skew);
+
+        qsrand(1);
+        NPositionClock clock;
+        qint64 now = 0;
+        qint64 truth = 0;
+        clock.setRate(rate, now);
+        clock.sample(truth, now);
+
+        // an hour of playback, sampled once a second, shown at 60 frames per second:
+        qint64 maxDrift = 0;
+        bool monotonic = true;
+        play(clock, now, truth, rate, skew, 3600 * SEC, maxDrift, monotonic);
+
+        QVERIFY(monotonic);
+        QVERIFY2(maxDrift < 15 * MSEC, qPrintable(QString::number(maxDrift / MSEC) + " ms"));
+    }
+
+    void testPauseResume()
+    {
+        qsrand(2);
+        NPositionClock clock;
+        qint64 now = 0;
+        qint64 truth = 0;
+        clock.setRate(1.0, now);
+        clock.sample(truth, now);
+
+        qint64 maxDrift = 0;
+        bool monotonic = true;
+        for (int i = 0; i < 20; ++i) {
+            play(clock, now, truth, 1.0, 1.001, 7 * SEC + 300 * MSEC, maxDrift, monotonic);
+
+            // paused, then resumed a bit later:
+            clock.setRate(0.0, now);
+            clock.sample(truth, now);
+            qint64 paused = clock.position(now);
+            now += 2 * SEC;
+            QCOMPARE(clock.position(now), paused);
+            clock.setRate(1.0, now);
+        }
+
+        QVERIFY(monotonic);
+        QVERIFY2(maxDrift < 15 * MSEC, qPrintable(QString::number(maxDrift / MSEC) + " ms"));
+    }
+};
+
+QTEST_MAIN(TestPositionClock)
+#include "testPositionClock.moc"
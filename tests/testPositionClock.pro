@@ -0,0 +1,6 @@
+include(test.pri)
+QT += testlib
+
+INCLUDEPATH += $$SRC_DIR/plugins
+TARGET = testPositionClock
+SOURCES += testPositionClock.cpp $$SRC_DIR/plugins/positionClock.cpp
@@ -0,0 +1,148 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#include <QSignalSpy>
+#include <QtTest/QtTest>
+
+#include "playbackEngineTest.h"
+
+#define NSEC_IN_MSEC 1000000.0
+#define SEEKS 20
+#define BURST_SEEKS 50
+#define SETTLE_MSEC 1000
+#define POSITION_TOLERANCE 0.05 // of the duration
+#define PLAYING_TIMEOUT_MSEC 5000
+
+// Measures, on the null sinks of a tests build, how long it takes from a seek request
+// until the first audio from the new position is rendered.
+class TestSeekLatency : public NPlaybackEngineTest
+{
+    Q_OBJECT
+
+    QVariantList seekLatencies()
+    {
+        QVariantList latencies;
+        QMetaObject::invokeMethod(m_playbackEngine, "_seekLatencies",
+                                  Q_RETURN_ARG(QVariantList, latencies));
+        return latencies;
+    }
+
+    int seeksIssued()
+    {
+        int seeks = 0;
+        QMetaObject::invokeMethod(m_playbackEngine, "_seeksIssued", Q_RETURN_ARG(int, seeks));
+        return seeks;
+    }
+
+    bool play(const QString &file, bool accurate)
+    {
+        QStringList formats;
+        if (accurate) {
+            formats << QFileInfo(file).suffix();
+        }
+        m_playbackEngine->setAccurateSeekFormats(formats);
+
+        QSignalSpy spy(m_playbackEngine, SIGNAL(stateChanged(N::PlaybackState)));
+        m_playbackEngine->setMedia(QFileInfo(file).absoluteFilePath(), 0);
+        m_playbackEngine->play();
+        while (m_playbackEngine->state() != N::PlaybackPlaying) {
+            if (!spy.wait(PLAYING_TIMEOUT_MSEC)) {
+                return false;
+            }
+        }
+        QTest::qWait(SETTLE_MSEC); // duration known, position sampled
+        return true;
+    }
+
+    static void addRows()
+    {
+        QTest::addColumn<QString>("file");
+        QTest::addColumn<bool>("accurate");
+        QTest::newRow("wav, key unit") << "seek.wav" << false;
+        QTest::newRow("wav, accurate") << "seek.wav" << true;
+        QTest::newRow("ogg, key unit") << "seek.ogg" << false;
+        QTest::newRow("ogg, accurate") << "seek.ogg" << true;
+    }
+
+private slots:
+    void initTestCase()
+    {
+        QStringList fixtures = QStringList() << "seek.wav"
+                                             << "seek.ogg";
+        QString skip = initPlaybackEngine("_seekLatencies()", fixtures);
+        if (!skip.isEmpty()) {
+            QSKIP(qPrintable(skip));
+        }
+    }
+
+    void cleanup() { m_playbackEngine->stop(); }
+
+    void testSeek_data() { addRows(); }
+
+    void testSeek()
+    {
+        QFETCH(QString, file);
+        QFETCH(bool, accurate);
+        QVERIFY(play(file, accurate));
+
+        qsrand(SEEKS);
+        int before = seekLatencies().size();
+        for (int i = 0; i < SEEKS; ++i) {
+            m_playbackEngine->setPosition((qrand() % 900) / 1000.0);
+            QTRY_COMPARE(seekLatencies().size(), before + i + 1);
+        }
+
+        QList<qint64> latencies;
+        foreach (const QVariant &latency, seekLatencies().mid(before)) {
+            latencies << latency.toLongLong();
+        }
+        std::sort(latencies.begin(), latencies.end());
+        QTest::setBenchmarkResult(latencies.at(latencies.size() / 2) / NSEC_IN_MSEC,
+                                  QTest::WalltimeMilliseconds);
+    }
+
+    void testBurst_data() { addRows(); }
+
+    void testBurst()
+    {
+        QFETCH(QString, file);
+        QFETCH(bool, accurate);
+        QVERIFY(play(file, accurate));
+
+        // dragging the slider across the whole track, with no event processed in between, so
+        // that the first seek is still in flight for all the others:
+        int before = seeksIssued();
+        qreal target = 0.0;
+        for (int i = 0; i < BURST_SEEKS; ++i) {
+            target = 0.1 + 0.8 * i / BURST_SEEKS;
+            m_playbackEngine->setPosition(target);
+        }
+        QTest::qWait(SETTLE_MSEC);
+
+        // the first one, the last target and, when accurate, its refinement off a key unit:
+        int issued = seeksIssued() - before;
+        QVERIFY2(issued <= (accurate ? 3 : 2),
+                 qPrintable(QString("%1 seeks issued for %2").arg(issued).arg(BURST_SEEKS)));
+        // landed on the last target, having played on since:
+        qreal expected = target + SETTLE_MSEC / (m_playbackEngine->durationMsec() * 1.0);
+        QVERIFY2(qAbs(m_playbackEngine->position() - expected) < POSITION_TOLERANCE,
+                 qPrintable(QString("at %1, expected %2")
+                                .arg(m_playbackEngine->position())
+                                .arg(expected)));
+    }
+};
+
+QTEST_MAIN(TestSeekLatency)
+#include "testSeekLatency.moc"
@@ -0,0 +1,10 @@
+include(test.pri)
+include(playbackEngineTest.pri)
+QT += testlib
+
+TARGET = testSeekLatency
+SOURCES += testSeekLatency.cpp
+
+# 10 seconds samples, uncompressed and with key units:
+gstFixture(seek.wav, audiotestsrc freq=440 samplesperbuffer=441 num-buffers=1000 ! audioconvert ! wavenc)
+gstFixture(seek.ogg, audiotestsrc freq=440 samplesperbuffer=441 num-buffers=1000 ! audioconvert ! vorbisenc ! oggmux)
@@ -0,0 +1,128 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#include <QSignalSpy>
+#include <QtTest/QtTest>
+
+#include "playbackEngineTest.h"
+#include "waveformBuilderInterface.h"
+
+#define RATE 44100
+#define TRACK_SEC 10
+#define LEVEL_FRAMES 3000 // loudness steps, a few bins each
+#define TAP_MSEC 1000
+#define SEEK_POSITION 0.8
+#define SEAM_BINS 2 // around the point the separate decoder takes over
+#define COMPLETE_TIMEOUT_MSEC 20000
+
+// Builds the waveform from the audio of the playback engine, seeks past what has been tapped
+// and checks that the separate decoder covering the rest continues it seamlessly.
+class TestSharedDecode : public NPlaybackEngineTest
+{
+    Q_OBJECT
+
+    QTemporaryDir m_dir;
+    NWaveformBuilderInterface *m_waveformBuilder{};
+
+    // a tone of changing loudness, different on every run so that no peaks cache knows it:
+    bool writeWav(const QString &fileName)
+    {
+        QFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        quint32 frames = RATE * TRACK_SEC;
+        QDataStream out(&file);
+        out.setByteOrder(QDataStream::LittleEndian);
+        out.writeRawData("RIFF", 4);
+        out << (quint32)(36 + frames * 2);
+        out.writeRawData("WAVEfmt ", 8);
+        out << (quint32)16 << (quint16)1 << (quint16)1 << (quint32)RATE << (quint32)(RATE * 2)
+            << (quint16)2 << (quint16)16;
+        out.writeRawData("data", 4);
+        out << (quint32)(frames * 2);
+
+        qsrand(QDateTime::currentMSecsSinceEpoch());
+        qreal amplitude = 0;
+        for (quint32 i = 0; i < frames; ++i) {
+            if (i % LEVEL_FRAMES == 0) {
+                amplitude = (qrand() % 1000) / 1000.0;
+            }
+            out << (qint16)(qSin(i * 0.1) * amplitude * 32767);
+        }
+        return out.status() == QDataStream::Ok;
+    }
+
+private slots:
+    void initTestCase()
+    {
+        QString skip = initPlaybackEngine("_renderedSpans()", QStringList());
+        if (!skip.isEmpty()) {
+            QSKIP(qPrintable(skip));
+        }
+
+        m_waveformBuilder = dynamic_cast<NWaveformBuilderInterface *>(
+            NPluginLoader::getPlugin(N::WaveformBuilder));
+        if (!m_waveformBuilder ||
+            m_waveformBuilder->metaObject()->indexOfMethod("_decodedBins(QString)") == -1) {
+            QSKIP("Waveform builder has no separate decode to compare with");
+        }
+        m_waveformBuilder->setSharedDecode(true);
+    }
+
+    void cleanupTestCase()
+    {
+        if (m_waveformBuilder) {
+            m_waveformBuilder->setSharedDecode(false);
+        }
+    }
+
+    void testRemainder()
+    {
+        QString file = m_dir.path() + "/tap.wav";
+        QVERIFY(writeWav(file));
+
+        QVariantList decoded;
+        QMetaObject::invokeMethod(m_waveformBuilder, "_decodedBins",
+                                  Q_RETURN_ARG(QVariantList, decoded), Q_ARG(QString, file));
+        QVERIFY(!decoded.isEmpty());
+
+        QSignalSpy spy(m_waveformBuilder, SIGNAL(peaksCompleted()));
+        m_playbackEngine->setMedia(file, 1);
+        m_playbackEngine->play();
+        QTest::qWait(TAP_MSEC);
+        m_waveformBuilder->start(file); // from the start, replayed
+        QTest::qWait(TAP_MSEC);
+        m_playbackEngine->setPosition(SEEK_POSITION); // leaves the rest to a separate decoder
+        bool completed = spy.wait(COMPLETE_TIMEOUT_MSEC);
+        m_playbackEngine->stop();
+        QVERIFY(completed);
+
+        const NWaveformPeaks &peaks = m_waveformBuilder->peaks();
+        QCOMPARE(peaks.size(0) * 2, decoded.size());
+        int differing = 0;
+        for (int i = 0; i < peaks.size(0); ++i) {
+            if (peaks.positive(0, i) != decoded.at(i * 2).toReal() ||
+                peaks.negative(0, i) != decoded.at(i * 2 + 1).toReal()) {
+                ++differing;
+            }
+        }
+        QVERIFY2(differing <= SEAM_BINS,
+                 qPrintable(QString("%1 bins of %2 differ").arg(differing).arg(peaks.size(0))));
+    }
+};
+
+QTEST_MAIN(TestSharedDecode)
+#include "testSharedDecode.moc"
@@ -0,0 +1,6 @@
+include(test.pri)
+include(playbackEngineTest.pri)
+QT += testlib
+
+TARGET = testSharedDecode
+SOURCES += testSharedDecode.cpp
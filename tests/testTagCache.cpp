@@ -0,0 +1,120 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "tagCache.h"
+
+static QMap<QChar, QString> makeTags(const QString &title)
+{
+    QMap<QChar, QString> tags;
+    tags['a'] = "Artist";
+    tags['t'] = title;
+    tags['D'] = "215";
+    tags['y'] = "";
+    return tags;
+}
+
+class TestTagCache : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir m_dir;
+
+    QString cacheFile() const { return m_dir.path() + "/test.tags"; }
+
+private slots:
+    void init() { QFile::remove(cacheFile()); }
+
+    void testReopen()
+    {
+        {
+            NTagCache cache(cacheFile());
+            cache.insert("/music/a.mp3", 1000, 10, "UTF-8", makeTags("A"));
+            cache.insert("/music/b.mp3", 2000, 20, "UTF-8", makeTags("B"));
+        }
+
+        NTagCache cache(cacheFile());
+        QMap<QChar, QString> tags;
+        QVERIFY(cache.read("/music/a.mp3", 1000, 10, "UTF-8", tags));
+        QCOMPARE(tags, makeTags("A"));
+        QVERIFY(cache.read("/music/b.mp3", 2000, 20, "UTF-8", tags));
+        QCOMPARE(tags, makeTags("B"));
+        QVERIFY(!cache.read("/music/c.mp3", 2000, 20, "UTF-8", tags));
+
+        // appended past the mapping:
+        cache.insert("/music/c.mp3", 3000, 30, "UTF-8", makeTags("C"));
+        QVERIFY(cache.read("/music/c.mp3", 3000, 30, "UTF-8", tags));
+        QCOMPARE(tags, makeTags("C"));
+    }
+
+    void testStale()
+    {
+        NTagCache cache(cacheFile());
+        cache.insert("/music/a.mp3", 1000, 10, "UTF-8", makeTags("A"));
+
+        QMap<QChar, QString> tags;
+        QVERIFY(!cache.read("/music/a.mp3", 1001, 10, "UTF-8", tags)); // resized
+        QVERIFY(!cache.read("/music/a.mp3", 1000, 11, "UTF-8", tags)); // modified
+        QVERIFY(!cache.read("/music/a.mp3", 1000, 10, "CP1251", tags));
+
+        cache.insert("/music/a.mp3", 1000, 11, "UTF-8", makeTags("A2"));
+        QVERIFY(cache.read("/music/a.mp3", 1000, 11, "UTF-8", tags));
+        QCOMPARE(tags, makeTags("A2"));
+    }
+
+    void testCompact()
+    {
+        qint64 grown;
+        {
+            NTagCache cache(cacheFile());
+            for (int i = 0; i < 20000; ++i) {
+                cache.insert("/music/a.mp3", 1000, i, "UTF-8", makeTags(QString::number(i)));
+            }
+            grown = cache.size();
+        }
+
+        // superseded records are dropped when opened again:
+        NTagCache cache(cacheFile());
+        QMap<QChar, QString> tags;
+        QVERIFY(cache.read("/music/a.mp3", 1000, 19999, "UTF-8", tags));
+        QCOMPARE(tags, makeTags("19999"));
+        QVERIFY(cache.size() < grown / 100);
+    }
+
+    void testTruncated()
+    {
+        {
+            NTagCache cache(cacheFile());
+            cache.insert("/music/a.mp3", 1000, 10, "UTF-8", makeTags("A"));
+            cache.insert("/music/b.mp3", 2000, 20, "UTF-8", makeTags("B"));
+        }
+
+        // an interrupted write:
+        QFile file(cacheFile());
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        file.resize(file.size() - 3);
+        file.close();
+
+        NTagCache cache(cacheFile());
+        QMap<QChar, QString> tags;
+        QVERIFY(cache.read("/music/a.mp3", 1000, 10, "UTF-8", tags));
+        QVERIFY(!cache.read("/music/b.mp3", 2000, 20, "UTF-8", tags));
+    }
+};
+
+QTEST_MAIN(TestTagCache)
+#include "testTagCache.moc"
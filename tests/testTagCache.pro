@@ -0,0 +1,6 @@
+include(test.pri)
+QT += testlib
+
+TARGET = testTagCache
+SOURCES += testTagCache.cpp
+INCLUDEPATH += ../src/
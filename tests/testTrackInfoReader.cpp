@@ -16,6 +16,7 @@
 #include <QMap>
 #include <QtTest/QtTest>
 
+#include "tagCache.h"
 #include "tagReaderInterface.h"
 #include "trackInfoReader.h"
 
@@ -174,6 +175,61 @@ private slots:
         m_infoReader->setSource(""); // file not set
         QCOMPARE(m_infoReader->toString("{\"%a - %t\" - |\"%F\" - }Nulloy"), "Nulloy");
     }
+
+    void test14()
+    {
+        // tags of many files at once, in the order of the files:
+        QStringList files = QStringList() << "/music/one.mp3"
+                                          << "/music/two.mp3";
+        QList<NTagData> results = m_tagReader->readMany(files, "atZ", "UTF-8");
+        QCOMPARE(results.size(), 2);
+        QCOMPARE(results.at(0).file, files.at(0));
+        QCOMPARE(results.at(1).file, files.at(1));
+        QCOMPARE(results.at(1).tags['a'], QString("<a>"));
+        QCOMPARE(results.at(1).tags['t'], QString("<t>"));
+        QCOMPARE(results.at(1).tags['Z'], QString("%Z")); // unsupported
+    }
+
+    void test15()
+    {
+        // tags read ahead are formatted like the ones of setSource(file):
+        m_tagReader->tags['D'] = "125";
+        QList<NTagData> results =
+            m_infoReader->readMany(QStringList() << "/music/one.mp3", "atD", "");
+        QCOMPARE(results.size(), 1);
+        m_tagReader->tags['a'] = "<changed>";
+        m_infoReader->setSource(results.at(0));
+        QCOMPARE(m_infoReader->toString("%a - %t (%d) %F"), "<a> - <t> (2:05) one.mp3");
+        QVERIFY(!m_infoReader->canReadMany()); // the default readMany() changes the source
+    }
+
+    void test16()
+    {
+        // only the given tags are cached, an entry without some of them is read again:
+        QTemporaryDir dir;
+        QStringList files = QStringList() << dir.path() + "/one.mp3";
+        QFile file(files.first());
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.close();
+        NTagCache cache(dir.path() + "/tags");
+        m_infoReader->setCache(&cache);
+
+        m_infoReader->readMany(files, "a", "UTF-8");
+        m_tagReader->tags['a'] = "<changed>";
+        QList<NTagData> results = m_infoReader->readMany(files, "a", "UTF-8");
+        QCOMPARE(results.at(0).tags.keys(), QList<QChar>() << 'a');
+        QCOMPARE(results.at(0).tags['a'], QString("<a>"));
+
+        results = m_infoReader->readMany(files, "at", "UTF-8");
+        QCOMPARE(results.at(0).tags['a'], QString("<changed>"));
+        QCOMPARE(results.at(0).tags['t'], QString("<t>"));
+
+        m_tagReader->tags['t'] = "<changed>";
+        results = m_infoReader->readMany(files, "t", "UTF-8");
+        QCOMPARE(results.at(0).tags['t'], QString("<t>"));
+
+        m_infoReader->setCache(NULL);
+    }
 };
 
 QTEST_MAIN(TrackInfoReaderTest)
@@ -0,0 +1,227 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+
+#include <QtTest/QtTest>
+
+#include "waveformCache.h"
+
+static NWaveformPeaks makePeaks(int bins, qreal amplitude)
+{
+    NWaveformPeaks peaks;
+    for (int i = 0; i < bins * NWaveformPeaks::BaseFactor; ++i) {
+        peaks.append(qSin(i) * amplitude);
+    }
+    peaks.complete();
+    return peaks;
+}
+
+class TestWaveformCache : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir m_dir;
+
+    QString cacheFile() const { return m_dir.path() + "/test.peaks"; }
+
+private slots:
+    void init() { QFile::remove(cacheFile()); }
+
+    void testReopen()
+    {
+        NWaveformPeaks peaks = makePeaks(500, 0.5);
+        {
+            NWaveformCache cache(cacheFile());
+            cache.insert("a", "2024-01-01T00:00:00", peaks);
+            cache.insert("b", "2024-01-02T00:00:00", makePeaks(10, 0.1));
+        }
+
+        NWaveformCache cache(cacheFile());
+        QCOMPARE(cache.date("a"), QString("2024-01-01T00:00:00"));
+        QCOMPARE(cache.date("b"), QString("2024-01-02T00:00:00"));
+        QVERIFY(cache.date("c").isEmpty());
+
+        NWaveformPeaks restored;
+        QVERIFY(cache.read("a", restored));
+        QVERIFY(restored.isCompleted());
+        QCOMPARE(restored.size(0), peaks.size(0));
+        QVERIFY(!cache.read("c", restored));
+    }
+
+    void testSupersede()
+    {
+        {
+            NWaveformCache cache(cacheFile());
+            cache.insert("a", "old", makePeaks(100, 0.5));
+            cache.insert("a", "new", makePeaks(200, 0.5));
+        }
+
+        NWaveformCache cache(cacheFile());
+        QCOMPARE(cache.date("a"), QString("new"));
+        NWaveformPeaks restored;
+        QVERIFY(cache.read("a", restored));
+        QCOMPARE(restored.size(0), 200);
+    }
+
+    void testCompact()
+    {
+        NWaveformCache cache(cacheFile());
+        for (int i = 0; i < 20; ++i) {
+            cache.insert("a", QString::number(i), makePeaks(1000, 0.5));
+        }
+        cache.insert("b", "b", makePeaks(300, 0.5));
+        qint64 before = QFileInfo(cacheFile()).size();
+
+        cache.compact();
+        QVERIFY(QFileInfo(cacheFile()).size() < before / 5);
+        QCOMPARE(cache.date("a"), QString("19"));
+
+        NWaveformPeaks restored;
+        QVERIFY(cache.read("a", restored));
+        QCOMPARE(restored.size(0), 1000);
+        QVERIFY(cache.read("b", restored));
+        QCOMPARE(restored.size(0), 300);
+
+        // appends after compaction land in the new file:
+        cache.insert("c", "c", makePeaks(50, 0.5));
+        QVERIFY(cache.read("c", restored));
+        QCOMPARE(restored.size(0), 50);
+    }
+
+    void testPaths()
+    {
+        {
+            NWaveformCache cache(cacheFile());
+            cache.insertPath("a", "2024-01-01T00:00:00", 1000, "content");
+            cache.insert("content", "2024-01-01T00:00:00", makePeaks(10, 0.5));
+        }
+
+        NWaveformCache cache(cacheFile());
+        QCOMPARE(cache.fingerprint("a", "2024-01-01T00:00:00", 1000), QByteArray("content"));
+        QVERIFY(cache.fingerprint("a", "2024-01-02T00:00:00", 1000).isEmpty());
+        QVERIFY(cache.fingerprint("a", "2024-01-01T00:00:00", 1001).isEmpty());
+        QVERIFY(cache.fingerprint("b", "2024-01-01T00:00:00", 1000).isEmpty());
+
+        // paths and peaks don't share keys:
+        QVERIFY(!cache.contains("a"));
+        QVERIFY(cache.contains("content"));
+
+        // a moved file maps to the same peaks:
+        cache.insertPath("b", "2024-01-01T00:00:00", 1000, "content");
+        cache.compact();
+        QCOMPARE(cache.fingerprint("a", "2024-01-01T00:00:00", 1000), QByteArray("content"));
+        QCOMPARE(cache.fingerprint("b", "2024-01-01T00:00:00", 1000), QByteArray("content"));
+    }
+
+    void testLegacy()
+    {
+        {
+            NWaveformCache cache(cacheFile());
+            cache.insert("a", "date", makePeaks(1000, 0.5));
+            cache.insert("b", "date", makePeaks(1000, 0.5));
+
+            // moved to its content key:
+            NWaveformPeaks peaks;
+            QVERIFY(cache.read("a", peaks));
+            cache.insert("content", "date", peaks);
+            cache.remove("a");
+            cache.insertPath("a", "date", 1000, "content");
+            QVERIFY(!cache.contains("a"));
+
+            // mapped without being removed, as if interrupted:
+            cache.insertPath("b", "date", 1000, "content");
+        }
+
+        NWaveformCache cache(cacheFile());
+        QVERIFY(!cache.contains("a"));
+        QVERIFY(!cache.contains("b"));
+        QVERIFY(cache.contains("content"));
+
+        qint64 size = cache.size();
+        cache.compact();
+        QVERIFY(cache.size() < size / 2);
+        QCOMPARE(cache.fingerprint("b", "date", 1000), QByteArray("content"));
+    }
+
+    void testEviction()
+    {
+        NWaveformCache cache(cacheFile());
+        for (int i = 0; i < 10; ++i) {
+            cache.insert(QByteArray::number(i), "date", makePeaks(1000, 0.5));
+            cache.insertPath("path" + QByteArray::number(i), "date", 1000, QByteArray::number(i));
+        }
+
+        NWaveformPeaks restored;
+        QVERIFY(cache.read("0", restored)); // recently used now
+
+        qint64 size = cache.size();
+        cache.setMaxSize(size / 2);
+        cache.compact();
+        QVERIFY(cache.size() <= size / 2);
+        QVERIFY(cache.evictions() > 0);
+
+        QVERIFY(cache.contains("0"));
+        QVERIFY(cache.contains("9"));
+        QVERIFY(!cache.contains("1"));
+        QVERIFY(cache.fingerprint("path1", "date", 1000).isEmpty());
+        QCOMPARE(cache.fingerprint("path9", "date", 1000), QByteArray("9"));
+    }
+
+    void testTruncated()
+    {
+        {
+            NWaveformCache cache(cacheFile());
+            cache.insert("a", "a", makePeaks(100, 0.5));
+            cache.insert("b", "b", makePeaks(100, 0.5));
+        }
+
+        QFile file(cacheFile());
+        file.open(QIODevice::ReadWrite);
+        file.resize(file.size() - 10);
+        file.close();
+
+        NWaveformCache cache(cacheFile());
+        QCOMPARE(cache.date("a"), QString("a"));
+        QVERIFY(cache.date("b").isEmpty());
+        NWaveformPeaks restored;
+        QVERIFY(cache.read("a", restored));
+    }
+
+    void testShared()
+    {
+        NWaveformCache writer(cacheFile());
+        writer.insert("a", "a", makePeaks(100, 0.5));
+
+        // a second user of the same log reads it, but leaves the writing to the first one:
+        {
+            NWaveformCache reader(cacheFile());
+            QCOMPARE(reader.date("a"), QString("a"));
+            qint64 size = QFileInfo(cacheFile()).size();
+            reader.insert("b", "b", makePeaks(100, 0.5));
+            reader.compact();
+            QCOMPARE(QFileInfo(cacheFile()).size(), size);
+            QVERIFY(reader.date("b").isEmpty());
+        }
+
+        writer.insert("c", "c", makePeaks(100, 0.5));
+        NWaveformPeaks restored;
+        QVERIFY(writer.read("a", restored));
+        QVERIFY(writer.read("c", restored));
+    }
+};
+
+QTEST_MAIN(TestWaveformCache)
+#include "testWaveformCache.moc"
@@ -0,0 +1,6 @@
+include(test.pri)
+QT += testlib
+
+INCLUDEPATH += $$SRC_DIR/plugins
+TARGET = testWaveformCache
+SOURCES += testWaveformCache.cpp $$SRC_DIR/plugins/waveformCache.cpp
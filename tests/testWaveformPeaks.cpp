@@ -0,0 +1,275 @@
+/********************************************************************
+**  Nulloy Music Player, http://nulloy.com
+**  Copyright (C) 2010-2024 Sergey Vlasov <sergey@vlasov.me>
+**
+**  This program can be distributed under the terms of the GNU
+**  General Public License version 3.0 as published by the Free
+**  Software Foundation and appearing in the file LICENSE.GPL3
+**  included in the packaging of this file.  Please review the
+**  following information to ensure the GNU General Public License
+**  version 3.0 requirements will be met:
+**
+**  http://www.gnu.org/licenses/gpl-3.0.html
+**
+*********************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "waveformPeaks.h"
+
+#define QUANT_STEP (1.0 / 32767)
+#define STORAGE_STEP (1.0 / 127)
+
+static bool near(qreal a, qreal b, qreal step)
+{
+    return qAbs(a - b) <= step;
+}
+
+static NWaveformPeaks::Bin producerBin(int i)
+{
+    return NWaveformPeaks::Bin(i % 30000, -(i % 30000));
+}
+
+// Appends bins in batches of random sizes and publishes them the way the
+// waveform builders do from their decoding threads.
+class NWaveformPeaksProducer : public QThread
+{
+private:
+    NWaveformPeaksRing *m_ring;
+    NWaveformPeaks m_peaks;
+    int m_count;
+
+public:
+    NWaveformPeaksProducer(NWaveformPeaksRing *ring, int count)
+        : m_ring(ring), m_count(count)
+    {
+    }
+
+    int count() const { return m_count; }
+    const NWaveformPeaks &peaks() const { return m_peaks; }
+
+    void run()
+    {
+        qsrand(1);
+        int published = 0;
+        NWaveformPeaks::Bin batch[256];
+        while (published < m_count) {
+            int size = m_peaks.size(0);
+            int n = qMin(qrand() % 256 + 1, m_count - size);
+            for (int i = 0; i < n; ++i) {
+                batch[i] = producerBin(size + i);
+            }
+            m_peaks.appendBins(batch, n);
+
+            int pending = m_peaks.size(0) - published;
+            for (int i = 0; i < qMin(pending, 256); ++i) {
+                batch[i] = m_peaks.bin(0, published + i);
+            }
+            published += m_ring->push(batch, qMin(pending, 256));
+        }
+    }
+};
+
+class TestWaveformPeaks : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testLevels()
+    {
+        NWaveformPeaks peaks;
+        int bins = 5000;
+        for (int i = 0; i < bins * NWaveformPeaks::BaseFactor; ++i) {
+            peaks.append(i % NWaveformPeaks::BaseFactor == 0 ? 0.5 : 0.0);
+        }
+        peaks.append(-0.5); // partial bin
+        peaks.complete();
+
+        QCOMPARE(peaks.size(0), bins + 1);
+        for (int level = 1; level < peaks.levels(); ++level) {
+            QCOMPARE(peaks.size(level), (peaks.size(level - 1) + 1) / 2);
+        }
+        QCOMPARE(peaks.size(peaks.levels() - 1), 1);
+
+        // the display level does not exceed 2048 bins:
+        QVERIFY(peaks.size() <= 2048);
+        QVERIFY(peaks.size() > 1024);
+
+        // tail is carried up to the top:
+        QVERIFY(near(peaks.negative(peaks.levels() - 1, 0), -0.5, QUANT_STEP));
+        QVERIFY(near(peaks.positive(peaks.levels() - 1, 0), 0.5, QUANT_STEP));
+    }
+
+    void testRange()
+    {
+        NWaveformPeaks peaks;
+        int bins = 4096;
+        for (int i = 0; i < bins; ++i) {
+            for (int j = 0; j < NWaveformPeaks::BaseFactor; ++j) {
+                peaks.append(i == 1000 ? 0.75 : 0.25);
+            }
+        }
+        peaks.complete();
+
+        qreal positive;
+        qreal negative;
+        peaks.range(1000.0 / bins, 1001.0 / bins, positive, negative);
+        QVERIFY(near(positive, 0.75, QUANT_STEP));
+        peaks.range(2000.0 / bins, 2001.0 / bins, positive, negative);
+        QVERIFY(near(positive, 0.25, QUANT_STEP));
+        peaks.range(0.0, 1.0, positive, negative);
+        QVERIFY(near(positive, 0.75, QUANT_STEP));
+    }
+
+    void testRing()
+    {
+        NWaveformPeaksRing ring(100); // rounded up to 128
+        NWaveformPeaks::Bin in[200];
+        NWaveformPeaks::Bin out[200];
+        for (int i = 0; i < 200; ++i) {
+            in[i] = NWaveformPeaks::Bin(i, -i);
+        }
+
+        // full ring takes no more:
+        QCOMPARE(ring.push(in, 200), 128);
+        QCOMPARE(ring.push(in, 1), 0);
+        QCOMPARE(ring.pop(out, 100), 100);
+        QCOMPARE(out[99], in[99]);
+
+        // wraps around:
+        QCOMPARE(ring.push(in + 128, 72), 72);
+        QCOMPARE(ring.pop(out, 200), 100);
+        for (int i = 0; i < 100; ++i) {
+            QCOMPARE(out[i], in[100 + i]);
+        }
+        QCOMPARE(ring.pop(out, 200), 0);
+    }
+
+    void testRingStress()
+    {
+        // the producer never waits for the consumer, it keeps whatever didn't fit; a full
+        // ring is covered by testRing(), whether it fills here depends on the scheduling:
+        NWaveformPeaksRing ring(1024);
+        NWaveformPeaksProducer producer(&ring, 4000000);
+        producer.start();
+
+        NWaveformPeaks view;
+        NWaveformPeaks::Bin batch[300];
+        int received = 0;
+        bool consistent = true;
+        while (consistent && (producer.isRunning() || received < producer.count())) {
+            int count = ring.pop(batch, qrand() % 300 + 1);
+            for (int i = 0; i < count; ++i, ++received) {
+                // every bin arrives once, in order and not half written:
+                consistent &= (batch[i] == producerBin(received));
+            }
+            view.appendBins(batch, count);
+        }
+        producer.wait();
+
+        QVERIFY(consistent);
+        QCOMPARE(received, producer.count());
+
+        // the consumer rebuilds the same pyramid as the producer:
+        const NWaveformPeaks &source = producer.peaks();
+        QCOMPARE(view.levels(), source.levels());
+        for (int level = 0; level < source.levels(); ++level) {
+            QCOMPARE(view.size(level), source.size(level));
+            int last = source.size(level) - 1;
+            QCOMPARE(view.bin(level, last), source.bin(level, last));
+        }
+    }
+
+    void testAppendBlock_data()
+    {
+        QTest::addColumn<int>("channels");
+        QTest::newRow("mono") << 1;
+        QTest::newRow("stereo") << 2;
+        QTest::newRow("three") << 3;
+        QTest::newRow("surround") << 6;
+    }
+
+    void testAppendBlock()
+    {
+        QFETCH(int, channels);
+
+        int frames = 100003;
+        QVector<qint16> pcm(frames * channels);
+        for (int i = 0; i < pcm.size(); ++i) {
+            pcm[i] = qrand() % 65536 - 32768;
+        }
+
+        NWaveformPeaks perSample;
+        for (int i = 0; i < frames; ++i) {
+            qint32 sum = 0;
+            for (int j = 0; j < channels; ++j) {
+                sum += pcm.at(i * channels + j);
+            }
+            perSample.append(-((qreal)sum / channels) / (1 << 15));
+        }
+        perSample.complete();
+
+        // blocks of odd sizes, not aligned to bins or vector widths:
+        NWaveformPeaks block;
+        for (int pos = 0, n = 1; pos < frames; pos += n, n = n * 3 % 4999 + 1) {
+            block.appendBlock(pcm.constData() + pos * channels, channels, qMin(n, frames - pos));
+        }
+        block.complete();
+
+        QCOMPARE(block.levels(), perSample.levels());
+        for (int level = 0; level < perSample.levels(); ++level) {
+            QCOMPARE(block.size(level), perSample.size(level));
+            for (int i = 0; i < perSample.size(level); ++i) {
+                QCOMPARE(block.positive(level, i), perSample.positive(level, i));
+                QCOMPARE(block.negative(level, i), perSample.negative(level, i));
+            }
+        }
+    }
+
+    void benchmarkAppendBlock()
+    {
+        // 10 seconds of stereo at 44.1 kHz:
+        QVector<qint16> pcm(44100 * 10 * 2);
+        for (int i = 0; i < pcm.size(); ++i) {
+            pcm[i] = qrand() % 65536 - 32768;
+        }
+
+        QBENCHMARK {
+            NWaveformPeaks peaks;
+            peaks.appendBlock(pcm.constData(), 2, pcm.size() / 2);
+        }
+    }
+
+    void testStream()
+    {
+        NWaveformPeaks peaks;
+        for (int i = 0; i < 3000 * NWaveformPeaks::BaseFactor; ++i) {
+            peaks.append(qSin(i) / 2);
+        }
+        peaks.complete();
+
+        QByteArray buffer;
+        QDataStream out(&buffer, QIODevice::WriteOnly);
+        out << peaks;
+
+        NWaveformPeaks restored;
+        QDataStream in(&buffer, QIODevice::ReadOnly);
+        in >> restored;
+
+        QVERIFY(restored.isCompleted());
+        QCOMPARE(restored.levels(), peaks.levels());
+        for (int level = 0; level < peaks.levels(); ++level) {
+            QCOMPARE(restored.size(level), peaks.size(level));
+            for (int i = 0; i < peaks.size(level); ++i) {
+                QVERIFY(near(restored.positive(level, i), peaks.positive(level, i), STORAGE_STEP));
+                QVERIFY(near(restored.negative(level, i), peaks.negative(level, i), STORAGE_STEP));
+            }
+        }
+
+        // one byte per value on disk:
+        QVERIFY(buffer.size() < peaks.size(0) * 2 + 64);
+    }
+};
+
+QTEST_MAIN(TestWaveformPeaks)
+#include "testWaveformPeaks.moc"
@@ -0,0 +1,5 @@
+include(test.pri)
+QT += testlib
+
+TARGET = testWaveformPeaks
+SOURCES += testWaveformPeaks.cpp